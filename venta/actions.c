@@ -0,0 +1,119 @@
+/*
+ Author: Alexander Knauer <a-x-e@gmx.net>
+ License: Apache 2.0
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include <digitalSTROM/dsuid.h>
+#include <dsvdc/dsvdc.h>
+
+#include "venta.h"
+
+/*
+ * Dynamic actions as advertised in dynamicActionDescriptions. The ids are hashed into a
+ * small open addressing table once, a generic request resolves its id with one hash and
+ * queues the target state of the action on the device command queue.
+ */
+
+typedef struct venta_action {
+  const char *id;
+  bool supported;
+  venta_state_t target;
+} venta_action_t;
+
+static const venta_action_t actions[] = {
+  { "ActTurnOn",       false, { -1, -1, -1 } },     // no power button in the Venta button API
+  { "ActTurnOff",      false, { -1, -1, -1 } },
+  { "ActFan1",         true,  {  1, -1, -1 } },
+  { "ActFan2",         true,  {  2, -1, -1 } },
+  { "ActFan3",         true,  {  3, -1, -1 } },
+  { "ActSleepModeOn",  true,  {  1,  1, -1 } },     // sleep mode runs on the lowest fan level
+  { "ActSleepModeOff", true,  { -1,  0, -1 } },
+  { "ActAutoModeOn",   true,  { -1, -1,  1 } },
+  { "ActAutoModeOff",  true,  { -1, -1,  0 } }
+};
+
+#define N_ACTIONS (sizeof(actions) / sizeof(actions[0]))
+#define ACTION_SLOTS 32                   /* power of two, at least twice the number of actions */
+
+static const venta_action_t *action_table[ACTION_SLOTS];
+static pthread_once_t action_table_once = PTHREAD_ONCE_INIT;
+
+static unsigned long action_calls = 0;
+static unsigned long action_deduplicated = 0;
+
+/* FNV-1a over the lower case id, action ids are matched case insensitive */
+static uint32_t action_hash(const char *id) {
+  uint32_t h = 2166136261u;
+
+  for (; *id; id++) {
+    h ^= (uint8_t) tolower((unsigned char) *id);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void build_action_table() {
+  for (size_t a = 0; a < N_ACTIONS; a++) {
+    uint32_t slot = action_hash(actions[a].id) & (ACTION_SLOTS - 1);
+    while (action_table[slot] != NULL) {
+      slot = (slot + 1) & (ACTION_SLOTS - 1);
+    }
+    action_table[slot] = &actions[a];
+  }
+}
+
+static const venta_action_t* find_action(const char *id) {
+  pthread_once(&action_table_once, build_action_table);
+
+  // descriptions announce the ids as "dynamic.<id>"
+  if (strncasecmp(id, "dynamic.", 8) == 0) {
+    id += 8;
+  }
+
+  uint32_t slot = action_hash(id) & (ACTION_SLOTS - 1);
+  while (action_table[slot] != NULL) {
+    if (strcasecmp(action_table[slot]->id, id) == 0) {
+      return action_table[slot];
+    }
+    slot = (slot + 1) & (ACTION_SLOTS - 1);
+  }
+  return NULL;
+}
+
+/*
+ * Queue the target state of a dynamic action and return at once, the plan is executed on the
+ * command thread of the device. Returns a DSVDC_* code for the generic response.
+ */
+uint8_t venta_invoke_action(venta_vdcd_t *dev, const char *id) {
+  const venta_action_t *action = find_action(id);
+
+  if (action == NULL) {
+    vdc_report(LOG_NOTICE, "action: %s not implemented\n", id);
+    return DSVDC_ERR_NOT_FOUND;
+  }
+  if (!action->supported) {
+    vdc_report(LOG_NOTICE, "action: %s is not supported by the Venta humifier\n", action->id);
+    return DSVDC_ERR_NOT_IMPLEMENTED;
+  }
+
+  action_calls++;
+  if (venta_command_in_flight(dev, &action->target)) {
+    action_deduplicated++;
+    vdc_report(LOG_INFO, "action: %s already in flight for %s, %lu of %lu calls deduplicated\n",
+        action->id, dev->dsuidstring, action_deduplicated, action_calls);
+    return DSVDC_OK;
+  }
+
+  vdc_report(LOG_NOTICE, "action: %s for %s\n", action->id, dev->dsuidstring);
+  venta_apply_state(dev, &action->target);
+  return DSVDC_OK;
+}
@@ -0,0 +1,528 @@
+/*
+ Author: Alexander Knauer <a-x-e@gmx.net>
+ License: Apache 2.0
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <digitalSTROM/dsuid.h>
+#include <dsvdc/dsvdc.h>
+
+#include "venta.h"
+
+/*
+ * Per device command queue with last-writer-wins semantics: a target state submitted
+ * while an older one still waits replaces it, a target arriving while a plan is executed
+ * makes the executor stop before the next press and re-plan from the state reached so far.
+ *
+ * The expected result of an executed plan is queued for the next push of the main loop as
+ * a tentative state, a poll shortly afterwards either confirms it or rolls it back to the
+ * polled values.
+ * The same poll verifies the operation: if the device did not reach the target, the missing
+ * presses are re-planned from the polled state, up to VENTA_MAX_RETRIES times and as long as
+ * the operation is within VENTA_SETTLE_DEADLINE.
+ *
+ * A pool of VENTA_COMMAND_WORKERS threads executes the commands of all devices. A device
+ * with a pending command is put on the run queue once, the worker taking it processes its
+ * commands until none is pending, so the commands of one device never run in parallel.
+ *
+ * Lock order: g_network_mutex before the queue mutex before the pool mutex, never the other
+ * way round.
+ */
+
+static struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  venta_vdcd_t *head;                   /* run queue, linked by commands.next_ready */
+  venta_vdcd_t *tail;
+  pthread_t threads[VENTA_COMMAND_WORKERS];
+  int n_threads;
+  bool stopping;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, { 0 }, 0, false };
+
+/* put the device on the run queue unless it is already there, queue mutex held */
+static void schedule(venta_vdcd_t *dev) {
+  venta_command_queue_t *queue = &dev->commands;
+
+  if (queue->scheduled) {
+    return;
+  }
+  pthread_mutex_lock(&pool.mutex);
+  // without workers the caller processes the commands itself, e.g. the simulation loop
+  if (pool.n_threads > 0 && !pool.stopping) {
+    queue->scheduled = true;
+    queue->next_ready = NULL;
+    if (pool.tail != NULL) {
+      pool.tail->commands.next_ready = dev;
+    } else {
+      pool.head = dev;
+    }
+    pool.tail = dev;
+    pthread_cond_signal(&pool.cond);
+  }
+  pthread_mutex_unlock(&pool.mutex);
+}
+
+static bool superseded(venta_command_queue_t *queue, uint32_t generation) {
+  bool newer;
+
+  pthread_mutex_lock(&queue->mutex);
+  newer = queue->generation != generation;
+  pthread_mutex_unlock(&queue->mutex);
+  return newer;
+}
+
+/* number of presses a target would need from current, NULL if the state is unknown */
+static int planned_presses(const venta_state_t *current, const venta_state_t *target) {
+  uint8_t presses[VENTA_MAX_PRESSES];
+
+  if (current == NULL) {
+    return 0;
+  }
+  int n = venta_plan(current, target, presses, VENTA_MAX_PRESSES);
+  return (n > 0) ? n : 0;
+}
+
+static void set_sensor(venta_vdcd_t *dev, char *name, int value, vdc_time_t now) {
+  sensor_value_t *svalue = find_sensor_value_by_name(dev, name);
+
+  if (svalue != NULL) {
+    svalue->last_value = svalue->value;
+    svalue->value = value;
+    svalue->last_query = now;
+  }
+}
+
+/* apply the expected state to the device snapshot and publish it before the device confirms it */
+static void set_tentative(venta_vdcd_t *dev, const venta_state_t *state) {
+  vdc_time_t now = vdc_clock_ms();
+
+  pthread_mutex_lock(&g_network_mutex);
+  venta_set_cached_state(dev, state);
+  set_sensor(dev, "fan", state->fan, now);
+  set_sensor(dev, "sleep", state->mode_sleep, now);
+  set_sensor(dev, "auto", state->mode_automatic, now);
+  dev->tentative = true;
+  dev->tentative_state = *state;
+  dev->tentative_since = now;
+  pthread_mutex_unlock(&g_network_mutex);
+
+  vdc_report(LOG_INFO, "scene: tentative state fan %d sleep %d auto %d\n", state->fan, state->mode_sleep, state->mode_automatic);
+  venta_push_changed(dev);
+  venta_schedule_poll(dev, now + VENTA_CONFIRM_DELAY);
+}
+
+/* executes the plan for target, returns the number of presses or a negative error code */
+static int execute_target(venta_vdcd_t *dev, const venta_state_t *target, uint32_t generation) {
+  venta_command_queue_t *queue = &dev->commands;
+  venta_state_t current;
+  uint8_t presses[VENTA_MAX_PRESSES];
+  int rc;
+
+  if (venta_get_cached_state(dev, &current) != VENTA_OK) {
+    // no valid values polled yet
+    venta_get_data(dev);
+    if (venta_get_cached_state(dev, &current) != VENTA_OK) {
+      vdc_report(LOG_ERR, "scene: current device state unknown\n");
+      return VENTA_GETMEASURE_FAILED;
+    }
+  }
+
+  int n = venta_plan(&current, target, presses, VENTA_MAX_PRESSES);
+  if (n < 0) {
+    vdc_report(LOG_ERR, "scene: target state fan %d sleep %d auto %d not reachable\n", target->fan, target->mode_sleep, target->mode_automatic);
+    return VENTA_CONFIGCHANGE_FAILED;
+  }
+  if (n == 0) {
+    vdc_report(LOG_INFO, "scene: device already in target state\n");
+    return 0;
+  }
+
+  vdc_report(LOG_INFO, "scene: %d button presses from fan %d sleep %d auto %d\n", n, current.fan, current.mode_sleep, current.mode_automatic);
+  for (int i = 0; i < n; i++) {
+    if (superseded(queue, generation)) {
+      vdc_report(LOG_INFO, "scene: superseded by a newer command after %d of %d presses\n", i, n);
+      pthread_mutex_lock(&queue->mutex);
+      queue->presses_saved += n - i;
+      pthread_mutex_unlock(&queue->mutex);
+      return VENTA_OK;
+    }
+
+    rc = venta_press_button(dev, presses[i]);
+    if (rc != VENTA_OK) {
+      // state after a partially executed plan is unknown
+      venta_request_refresh(dev);
+      return VENTA_CONNECT_FAILED;
+    }
+
+    /* a re-plan has to start from the state reached so far */
+    venta_button_apply(presses[i], &current);
+    venta_set_cached_state(dev, &current);
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->presses++;
+    pthread_mutex_unlock(&queue->mutex);
+  }
+
+  set_tentative(dev, &current);
+  return n;
+}
+
+/* statistics of the running operation, added on the first call of its scene, NULL if out of memory */
+static venta_scene_stats_t* operation_stats(venta_command_queue_t *queue) {
+  int scene = (queue->op_scene >= 0 && queue->op_scene < DS_SCENES) ? queue->op_scene : DS_SCENES;
+  int i;
+
+  for (i = 0; i < queue->n_stats && queue->stats[i].scene < scene; i++);
+  if (i < queue->n_stats && queue->stats[i].scene == scene) {
+    return &queue->stats[i];
+  }
+
+  venta_scene_stats_t *stats = realloc(queue->stats, (queue->n_stats + 1) * sizeof(venta_scene_stats_t));
+  if (stats == NULL) {
+    return NULL;
+  }
+  memmove(&stats[i + 1], &stats[i], (queue->n_stats - i) * sizeof(venta_scene_stats_t));
+  memset(&stats[i], 0, sizeof(venta_scene_stats_t));
+  stats[i].scene = scene;
+  queue->stats = stats;
+  queue->n_stats++;
+  return &stats[i];
+}
+
+/* close the running operation, queue mutex held */
+static void finish_operation(venta_command_queue_t *queue, bool settled, vdc_time_t now) {
+  venta_scene_stats_t *stats = operation_stats(queue);
+  vdc_time_t elapsed = now - queue->op_started;
+
+  if (settled) {
+    if (stats != NULL) {
+      stats->settled++;
+      stats->settle_total += elapsed;
+      if (elapsed > stats->settle_max) {
+        stats->settle_max = elapsed;
+      }
+    }
+    vdc_report(LOG_INFO, "scene: %d settled after %lld ms, %d retries\n", queue->op_scene, (long long) elapsed, queue->op_retries);
+  } else {
+    if (stats != NULL) {
+      stats->failed++;
+    }
+    vdc_report(LOG_ERR, "scene: %d did not settle after %lld ms, %d retries\n", queue->op_scene, (long long) elapsed, queue->op_retries);
+  }
+  queue->op_active = false;
+  queue->op_verify = false;
+}
+
+/* a new operation replaces an unverified older one, queue mutex held */
+static void start_operation(venta_command_queue_t *queue, const venta_state_t *target, int scene, vdc_time_t now) {
+  if (queue->op_active) {
+    venta_scene_stats_t *stats = operation_stats(queue);
+    if (stats != NULL) {
+      stats->superseded++;
+    }
+  }
+  queue->op_active = true;
+  queue->op_verify = false;
+  queue->op_target = *target;
+  queue->op_scene = scene;
+  queue->op_retries = 0;
+  queue->op_started = now;
+  venta_scene_stats_t *stats = operation_stats(queue);
+  if (stats != NULL) {
+    stats->calls++;
+  }
+}
+
+void venta_commands_init(venta_vdcd_t *dev) {
+  venta_command_queue_t *queue = &dev->commands;
+
+  memset(queue, 0, sizeof(venta_command_queue_t));
+  pthread_mutex_init(&queue->mutex, NULL);
+}
+
+/* release the queue of a device that is no longer on the run queue, e.g. after venta_commands_stop() */
+void venta_commands_destroy(venta_vdcd_t *dev) {
+  venta_command_queue_t *queue = &dev->commands;
+
+  pthread_mutex_destroy(&queue->mutex);
+  free(queue->stats);
+  queue->stats = NULL;
+  queue->n_stats = 0;
+}
+
+void venta_command_submit(venta_vdcd_t *dev, const venta_state_t *target, int scene) {
+  venta_command_queue_t *queue = &dev->commands;
+  venta_state_t current;
+
+  // lock order is g_network_mutex before queue->mutex, so the cached state is read first
+  bool current_valid = (venta_get_cached_state(dev, &current) == VENTA_OK);
+
+  pthread_mutex_lock(&queue->mutex);
+  queue->submitted++;
+  if (queue->pending) {
+    // older target has not been started yet, drop it
+    queue->coalesced++;
+    queue->presses_saved += planned_presses(current_valid ? &current : NULL, &queue->target);
+    vdc_report(LOG_INFO, "scene: coalescing pending command\n");
+  }
+  queue->target = *target;
+  queue->scene = scene;
+  queue->retry = false;
+  queue->pending = true;
+  queue->generation++;
+  schedule(dev);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+/* execute submitted targets until no command is pending */
+void venta_commands_process(venta_vdcd_t *dev) {
+  venta_command_queue_t *queue = &dev->commands;
+
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->pending) {
+    venta_state_t target = queue->target;
+    uint32_t generation = queue->generation;
+    if (!queue->retry) {
+      start_operation(queue, &target, queue->scene, vdc_clock_ms());
+    }
+    queue->pending = false;
+    queue->retry = false;
+    queue->busy = true;
+    pthread_mutex_unlock(&queue->mutex);
+
+    int rc = execute_target(dev, &target, generation);
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->generation != generation) {
+      // superseded, the newer command is verified instead
+      continue;
+    }
+    if (rc > 0 || rc == VENTA_CONNECT_FAILED || (rc == 0 && dev->tentative)) {
+      // verified by the confirmation poll, or by the refresh after a failed press
+      queue->op_verify = true;
+    } else {
+      finish_operation(queue, rc == 0, vdc_clock_ms());
+    }
+  }
+  queue->busy = false;
+  vdc_report(LOG_INFO, "commands: %s: %lu submitted, %lu coalesced, %lu presses, %lu presses saved, %lu confirmed, %lu rolled back\n",
+      dev->dsuidstring, queue->submitted, queue->coalesced, queue->presses, queue->presses_saved, queue->confirmed, queue->rolled_back);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+bool venta_commands_idle(venta_vdcd_t *dev) {
+  bool idle;
+
+  pthread_mutex_lock(&dev->commands.mutex);
+  idle = !dev->commands.pending && !dev->commands.busy;
+  pthread_mutex_unlock(&dev->commands.mutex);
+  return idle;
+}
+
+/* verification poll of the running operation: settle it, or re-plan the missing presses */
+static void verify_operation(venta_vdcd_t *dev, const venta_state_t *polled, bool polled_valid) {
+  venta_command_queue_t *queue = &dev->commands;
+  vdc_time_t now = vdc_clock_ms();
+
+  pthread_mutex_lock(&queue->mutex);
+  if (queue->op_active && queue->op_verify) {
+    if (polled_valid && venta_state_matches(polled, &queue->op_target)) {
+      finish_operation(queue, true, now);
+    } else if (queue->op_retries < VENTA_MAX_RETRIES && now - queue->op_started < VENTA_SETTLE_DEADLINE) {
+      queue->op_retries++;
+      venta_scene_stats_t *stats = operation_stats(queue);
+      if (stats != NULL) {
+        stats->retries++;
+      }
+      vdc_report(LOG_WARNING, "scene: %d not reached, retry %d of %d\n", queue->op_scene, queue->op_retries, VENTA_MAX_RETRIES);
+      queue->op_verify = false;
+      queue->target = queue->op_target;
+      queue->retry = true;
+      queue->pending = true;
+      queue->generation++;
+      schedule(dev);
+    } else {
+      finish_operation(queue, false, now);
+    }
+  }
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+/*
+ * Check a fresh poll against the tentative state of the last command and verify the running
+ * operation. Returns true if the pushed state was wrong, the polled values already replaced
+ * it and have to be pushed.
+ */
+bool venta_confirm_state(venta_vdcd_t *dev) {
+  venta_state_t polled;
+  bool polled_valid;
+  bool rollback = false;
+
+  if (!venta_commands_idle(dev)) {
+    // a newer command is running, it publishes its own tentative state
+    return false;
+  }
+
+  pthread_mutex_lock(&g_network_mutex);
+  polled_valid = (venta_get_cached_state(dev, &polled) == VENTA_OK);
+  if (dev->tentative) {
+    dev->tentative = false;
+    vdc_time_t elapsed = vdc_clock_ms() - dev->tentative_since;
+
+    if (polled.fan == dev->tentative_state.fan &&
+        polled.mode_sleep == dev->tentative_state.mode_sleep &&
+        polled.mode_automatic == dev->tentative_state.mode_automatic) {
+      vdc_report(LOG_INFO, "scene: tentative state confirmed after %lld ms\n", (long long) elapsed);
+      pthread_mutex_lock(&dev->commands.mutex);
+      dev->commands.confirmed++;
+      pthread_mutex_unlock(&dev->commands.mutex);
+    } else {
+      vdc_report(LOG_WARNING, "scene: tentative state fan %d sleep %d auto %d rolled back to fan %d sleep %d auto %d after %lld ms\n",
+          dev->tentative_state.fan, dev->tentative_state.mode_sleep, dev->tentative_state.mode_automatic,
+          polled.fan, polled.mode_sleep, polled.mode_automatic, (long long) elapsed);
+      pthread_mutex_lock(&dev->commands.mutex);
+      dev->commands.rolled_back++;
+      pthread_mutex_unlock(&dev->commands.mutex);
+      rollback = true;
+    }
+  }
+  pthread_mutex_unlock(&g_network_mutex);
+
+  verify_operation(dev, &polled, polled_valid);
+  return rollback;
+}
+
+static bool same_target(const venta_state_t *a, const venta_state_t *b) {
+  return a->fan == b->fan && a->mode_sleep == b->mode_sleep && a->mode_automatic == b->mode_automatic;
+}
+
+/*
+ * target is queued or its presses are being sent. An operation waiting for its verification
+ * poll does not count, the device may be unreachable and a repeated command must get through.
+ */
+bool venta_command_in_flight(venta_vdcd_t *dev, const venta_state_t *target) {
+  venta_command_queue_t *queue = &dev->commands;
+  bool in_flight;
+
+  pthread_mutex_lock(&queue->mutex);
+  if (queue->pending) {
+    in_flight = same_target(&queue->target, target);
+  } else {
+    in_flight = queue->op_active && !queue->op_verify && same_target(&queue->op_target, target);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return in_flight;
+}
+
+static void* commandWorker(void *arg __attribute__((unused))) {
+  pthread_mutex_lock(&pool.mutex);
+  while (!pool.stopping) {
+    venta_vdcd_t *dev = pool.head;
+    if (dev == NULL) {
+      pthread_cond_wait(&pool.cond, &pool.mutex);
+      continue;
+    }
+    pool.head = dev->commands.next_ready;
+    if (pool.head == NULL) {
+      pool.tail = NULL;
+    }
+    pthread_mutex_unlock(&pool.mutex);
+
+    venta_commands_process(dev);
+
+    // a command submitted meanwhile found the device scheduled, queue it again
+    venta_command_queue_t *queue = &dev->commands;
+    pthread_mutex_lock(&queue->mutex);
+    queue->scheduled = false;
+    if (queue->pending) {
+      schedule(dev);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    pthread_mutex_lock(&pool.mutex);
+  }
+  pthread_mutex_unlock(&pool.mutex);
+
+  return NULL;
+}
+
+/* commands are executed by the worker pool, the dsvdc callbacks must not block on the device */
+int venta_commands_start() {
+  pthread_mutex_lock(&pool.mutex);
+  pool.stopping = false;
+  while (pool.n_threads < VENTA_COMMAND_WORKERS) {
+    if (pthread_create(&pool.threads[pool.n_threads], NULL, &commandWorker, NULL) != 0) {
+      pthread_mutex_unlock(&pool.mutex);
+      vdc_report(LOG_ERR, "Command thread initialization failed\n");
+      venta_commands_stop();
+      return -1;
+    }
+    pool.n_threads++;
+  }
+  pthread_mutex_unlock(&pool.mutex);
+  return 0;
+}
+
+/* stop the workers, commands not started yet are discarded */
+void venta_commands_stop() {
+  venta_vdcd_t *dev, *next;
+
+  pthread_mutex_lock(&pool.mutex);
+  pool.stopping = true;
+  pthread_cond_broadcast(&pool.cond);
+  pthread_mutex_unlock(&pool.mutex);
+
+  for (int i = 0; i < pool.n_threads; i++) {
+    pthread_join(pool.threads[i], NULL);
+  }
+
+  pthread_mutex_lock(&pool.mutex);
+  pool.n_threads = 0;
+  dev = pool.head;
+  pool.head = pool.tail = NULL;
+  pthread_mutex_unlock(&pool.mutex);
+
+  for (; dev != NULL; dev = next) {
+    pthread_mutex_lock(&dev->commands.mutex);
+    next = dev->commands.next_ready;
+    dev->commands.scheduled = false;
+    pthread_mutex_unlock(&dev->commands.mutex);
+  }
+}
+
+/* bring the device into the target state with as few button presses as possible */
+int venta_apply_state(venta_vdcd_t *dev, const venta_state_t *target) {
+  venta_command_submit(dev, target, -1);
+  return VENTA_OK;
+}
+
+int venta_call_scene(venta_vdcd_t *dev, const scene_t *scene) {
+  venta_command_submit(dev, &scene->target, scene->dsId);
+  return VENTA_OK;
+}
+
+void venta_commands_report(venta_vdcd_t *dev) {
+  venta_command_queue_t *queue = &dev->commands;
+
+  pthread_mutex_lock(&queue->mutex);
+  for (int i = 0; i < queue->n_stats; i++) {
+    venta_scene_stats_t *stats = &queue->stats[i];
+    int s = stats->scene;
+    unsigned long verified = stats->settled + stats->failed;
+    if (stats->calls == 0) {
+      continue;
+    }
+    vdc_report(LOG_NOTICE, "commands: %s: %s %d: %lu calls, %lu settled (%.0f%%), %lu failed, %lu superseded, %lu retries, settle avg %lld ms max %lld ms\n",
+        dev->dsuidstring, (s < DS_SCENES) ? "scene" : "direct", (s < DS_SCENES) ? s : -1,
+        stats->calls, stats->settled, verified ? 100.0 * stats->settled / verified : 0.0, stats->failed, stats->superseded, stats->retries,
+        (long long) (stats->settled ? stats->settle_total / (vdc_time_t) stats->settled : 0), (long long) stats->settle_max);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+}
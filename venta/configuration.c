@@ -12,22 +12,338 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <stdarg.h>
+#include <libgen.h>
 #include <libconfig.h>
 #include <utlist.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <digitalSTROM/dsuid.h>
 #include <dsvdc/dsvdc.h>
 
 #include "venta.h"
 
+/* pending debounced configuration write, 0 if none */
+static vdc_time_t config_write_time = 0;
+static unsigned int config_changes = 0;
+
+/* the configuration was assembled from @include files and is not rewritten, see read_config */
+static bool config_includes = false;
+static bool config_has_dsuids = false;
+
+/* sensor configurations, one per sensor_values group, shared by all devices configured with it */
+typedef struct sensor_table {
+  struct sensor_table *next;
+  const config_setting_t *group;        /* only valid while read_config() holds the configuration */
+  int n_sensors;
+  sensor_config_t *config;
+} sensor_table_t;
+
+static sensor_table_t *sensor_tables = NULL;
+
+static void config_report(int level, const config_setting_t *setting, const char *fmt, va_list args) {
+  char msg[256];
+
+  vsnprintf(msg, sizeof(msg), fmt, args);
+  const char *file = config_setting_source_file(setting);
+  vdc_report(level, "%s:%u: %s\n", file ? file : g_cfgfile, config_setting_source_line(setting), msg);
+}
+
+/* report a configuration error at the file and line of a setting, returns 1 for error counts */
+static int config_error(const config_setting_t *setting, const char *fmt, ...) {
+  va_list args;
+
+  va_start(args, fmt);
+  config_report(LOG_ERR, setting, fmt, args);
+  va_end(args);
+  return 1;
+}
+
+/* report a setting that is ignored at the file and line of the setting */
+static void config_warning(const config_setting_t *setting, const char *fmt, ...) {
+  va_list args;
+
+  va_start(args, fmt);
+  config_report(LOG_WARNING, setting, fmt, args);
+  va_end(args);
+}
+
+/*
+ * sensor_values group s0, s1, ... of a device or the defaults for all devices. A group is
+ * read once, *table receives the configuration shared by all devices using the group.
+ * Returns the number of errors.
+ */
+static int read_sensor_values(config_setting_t *group, int n_sensors, sensor_config_t **table) {
+  const char *sval;
+  int ivalue;
+  int errors = 0;
+  sensor_table_t *t;
+
+  *table = NULL;
+  if (n_sensors == 0) {
+    return 0;
+  }
+  LL_FOREACH(sensor_tables, t) {
+    if (t->group == group) {
+      *table = t->config;
+      return 0;
+    }
+  }
+  t = calloc(1, sizeof(sensor_table_t));
+  if (t == NULL || (t->config = calloc(n_sensors, sizeof(sensor_config_t))) == NULL) {
+    vdc_report(LOG_ERR, "out of memory for sensor_values\n");
+    free(t);
+    return 1;
+  }
+  t->group = group;
+  t->n_sensors = n_sensors;
+  LL_PREPEND(sensor_tables, t);
+  *table = t->config;
+
+  for (int i = 0; i < n_sensors; i++) {
+    config_setting_t *s = config_setting_get_elem(group, i);
+    sensor_config_t *config = &t->config[i];
+
+    if (!config_setting_is_group(s)) {
+      errors += config_error(s, "sensor %d is not a group", i);
+      continue;
+    }
+
+    if (config_setting_lookup_string(s, "value_name", &sval)) {
+      config->value_name = strdup(sval);
+    } else {
+      errors += config_error(s, "sensor %s has no value_name", config_setting_name(s));
+      config->value_name = strdup("");
+    }
+
+    if (config_setting_lookup_int(s, "sensor_type", &ivalue))
+      config->sensor_type = ivalue;
+
+    if (config_setting_lookup_int(s, "sensor_usage", &ivalue))
+      config->sensor_usage = ivalue;
+
+    if (!config_setting_lookup_float(s, "deadband", &config->deadband)) {
+      config->deadband = 0;
+    }
+
+    if (!config_setting_lookup_int(s, "min_push_interval", &ivalue)) {
+      ivalue = VENTA_MIN_PUSH_INTERVAL;
+    }
+    config->min_push_interval = (vdc_time_t) ivalue * 1000;
+
+    if (!config_setting_lookup_int(s, "alive_sign_interval", &ivalue)) {
+      ivalue = VENTA_ALIVE_SIGN_INTERVAL;
+    }
+    config->alive_sign_interval = (vdc_time_t) ivalue * 1000;
+  }
+  return errors;
+}
+
+/* optional scene value, -1 if not set or out of range, the scene then leaves it unchanged */
+static int read_scene_value(config_setting_t *s, const char *name, int min, int max) {
+  int ivalue;
+
+  if (!config_setting_lookup_int(s, name, &ivalue)) {
+    return -1;
+  }
+  if (ivalue < min || ivalue > max) {
+    config_warning(s, "scene %s: %s %d out of range %d..%d, ignored", config_setting_name(s), name, ivalue, min, max);
+    return -1;
+  }
+  return ivalue;
+}
+
+/* scenes group s0, s1, ... of a device, the scene table is sized to the configured scenes, returns the number of errors */
+static int read_scenes(config_setting_t *group, venta_humifier_t *humifier) {
+  int ivalue;
+  int errors = 0;
+  int n = (group != NULL) ? config_setting_length(group) : 0;
+
+  if (n > MAX_SCENES) {
+    errors += config_error(group, "%d scenes configured, at most %d are supported", n, MAX_SCENES);
+    n = MAX_SCENES;
+  }
+  if (n == 0) {
+    return errors;
+  }
+  humifier->scenes = calloc(n, sizeof(scene_t));
+  if (humifier->scenes == NULL) {
+    vdc_report(LOG_ERR, "out of memory for %d scenes of %s\n", n, humifier->id);
+    return errors + 1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    config_setting_t *s = config_setting_get_elem(group, i);
+    scene_t* value = &humifier->scenes[humifier->n_scenes];
+
+    if (!config_setting_is_group(s)) {
+      errors += config_error(s, "scene %d is not a group", i);
+      continue;
+    }
+    if (!config_setting_lookup_int(s, "dsId", &ivalue)) {
+      errors += config_error(s, "scene %s has no dsId", config_setting_name(s));
+      continue;
+    }
+    if (ivalue < 0 || ivalue >= DS_SCENES) {
+      errors += config_error(s, "scene %s: dsId %d out of range", config_setting_name(s), ivalue);
+      continue;
+    }
+    if (is_scene_configured(humifier, ivalue)) {
+      errors += config_error(s, "scene %s: dsId %d is configured twice", config_setting_name(s), ivalue);
+      continue;
+    }
+    value->dsId = ivalue;
+    value->fan = read_scene_value(s, "fan", VENTA_FAN_MIN, VENTA_FAN_MAX);
+    value->mode_automatic = read_scene_value(s, "mode_automatic", 0, 1);
+    value->mode_sleep = read_scene_value(s, "mode_sleep", 0, 1);
+
+    value->target = venta_compile_scene(value);
+    humifier->n_scenes++;
+    index_scene(humifier, value);
+  }
+  return errors;
+}
+
+void venta_sensor_config_free() {
+  sensor_table_t *t, *tmp;
+
+  LL_FOREACH_SAFE(sensor_tables, t, tmp) {
+    LL_DELETE(sensor_tables, t);
+    for (int i = 0; i < t->n_sensors; i++) {
+      free(t->config[i].value_name);
+    }
+    free(t->config);
+    free(t);
+  }
+}
+
+/* allocate a device and its sensor states cache line aligned, see venta_vdcd_t */
+venta_vdcd_t* venta_device_new(venta_humifier_t *humifier, sensor_config_t *sensor_config, int n_sensors) {
+  venta_vdcd_t *dev;
+  void *p;
+
+  if (posix_memalign(&p, VENTA_CACHE_LINE, sizeof(venta_vdcd_t)) != 0) {
+    return NULL;
+  }
+  dev = p;
+  memset(dev, 0, sizeof(venta_vdcd_t));
+
+  if (n_sensors > 0) {
+    if (posix_memalign(&p, VENTA_CACHE_LINE, n_sensors * sizeof(sensor_value_t)) != 0) {
+      free(dev);
+      return NULL;
+    }
+    dev->sensors = p;
+    memset(dev->sensors, 0, n_sensors * sizeof(sensor_value_t));
+  }
+  dev->n_sensors = n_sensors;
+  dev->sensor_config = sensor_config;
+  dev->announced = false;
+  dev->present = true;
+  dev->humifier = humifier;
+  venta_commands_init(dev);
+  return dev;
+}
+
+/*
+ * Create a device from a humifier group, sensors default to the top level sensor_values.
+ * The whole group is checked and every error reported, the device is only added if there
+ * were none. Returns the number of errors.
+ */
+static int read_humifier(config_setting_t *group, config_setting_t *default_sensors, int index) {
+  const char *sval;
+  venta_vdcd_t *dev;
+  int errors = 0;
+
+  if (!config_setting_is_group(group)) {
+    return config_error(group, "humifier %d is not a group", index);
+  }
+  if (config_setting_source_file(group) != NULL && strcmp(config_setting_source_file(group), g_cfgfile) != 0) {
+    config_includes = true;
+  }
+
+  venta_humifier_t *humifier = calloc(1, sizeof(venta_humifier_t));
+  if (humifier == NULL) {
+    vdc_report(LOG_ERR, "out of memory for humifier %d\n", index);
+    return 1;
+  }
+
+  if (config_setting_lookup_string(group, "name", &sval)) {
+    humifier->name = strdup(sval);
+  } else if (config_setting_name(group) != NULL) {
+    humifier->name = strdup(config_setting_name(group));
+  }
+  if (config_setting_lookup_string(group, "id", &sval) && sval[0] != 0) {
+    humifier->id = strdup(sval);
+  } else {
+    errors += config_error(group, "mandatory parameter 'id' of humifier %d is not set", index);
+    humifier->id = strdup("");
+  }
+  if (humifier->name == NULL) {
+    humifier->name = strdup(humifier->id);
+  }
+  if (config_setting_lookup_string(group, "ip", &sval)) {
+    humifier->ip = strdup(sval);
+  } else {
+    errors += config_error(group, "mandatory parameter 'ip' of humifier %s is not set", humifier->id);
+  }
+  if (humifier->id[0] != 0) {
+    LL_FOREACH(humifier_device, dev) {
+      if (strcmp(dev->humifier->id, humifier->id) == 0) {
+        errors += config_error(group, "humifier id %s is configured twice", humifier->id);
+        break;
+      }
+    }
+  }
+
+  config_setting_t *sensors = config_setting_get_member(group, "sensor_values");
+  if (sensors == NULL) {
+    sensors = default_sensors;
+  }
+  int n_sensors = (sensors != NULL) ? config_setting_length(sensors) : 0;
+  if (n_sensors > MAX_SENSOR_VALUES) {
+    errors += config_error(sensors, "%d sensors configured, at most %d are supported", n_sensors, MAX_SENSOR_VALUES);
+    n_sensors = MAX_SENSOR_VALUES;
+  }
+
+  sensor_config_t *sensor_config;
+  errors += read_sensor_values(sensors, n_sensors, &sensor_config);
+
+  dev = venta_device_new(humifier, sensor_config, n_sensors);
+  if (dev == NULL) {
+    vdc_report(LOG_ERR, "out of memory for humifier %s\n", humifier->id);
+    return errors + 1;
+  }
+  errors += read_scenes(config_setting_get_member(group, "scenes"), humifier);
+  if (errors > 0) {
+    return errors;
+  }
+
+  dsuid_generate_v3_from_namespace(DSUID_NS_IEEE_MAC, humifier->id, &dev->dsuid);
+  dsuid_to_string(&dev->dsuid, dev->dsuidstring);
+
+  venta_properties_build(dev);
+  LL_APPEND(humifier_device, dev);
+  return 0;
+}
+
+/*
+ * The devices are configured in humifiers, each entry with its own id, ip, scenes and
+ * optionally sensor_values. humifiers is a list, or a group of named entries so that every
+ * device can live in its own file pulled in with @include; relative includes are resolved
+ * against the directory of the configuration file. The single group humifier of older
+ * configurations is read as a list of one.
+ *
+ * The setting tree is walked by element, so loading is linear in the size of the file. All
+ * devices are checked in one pass and every error is reported before the load is rejected.
+ */
 int read_config() {
   config_t config;
   struct stat statbuf;
-  int i;
   char *sval;
   int ivalue;
-  bool bvalue;
+  int errors = 0;
 
   if (stat(g_cfgfile, &statbuf) != 0) {
     vdc_report(LOG_ERR, "Could not find configuration file %s\n", g_cfgfile);
@@ -39,16 +355,28 @@ int read_config() {
   }
 
   config_init(&config);
+  char *cfgdir = strdup(g_cfgfile);
+  if (cfgdir != NULL) {
+    config_set_include_dir(&config, dirname(cfgdir));
+  }
   if (!config_read_file(&config, g_cfgfile)) {
-    vdc_report(LOG_ERR, "Error in configuration: l.%d %s\n", config_error_line(&config), config_error_text(&config));
+    const char *file = config_error_file(&config);
+    vdc_report(LOG_ERR, "Error in configuration: %s:%d %s\n", file ? file : g_cfgfile, config_error_line(&config), config_error_text(&config));
     config_destroy(&config);
+    free(cfgdir);
     return -3;
   }
+  free(cfgdir);
 
+  config_has_dsuids = true;
   if (config_lookup_string(&config, "vdcdsuid", (const char **) &sval))
     strncpy(g_vdc_dsuid, sval, sizeof(g_vdc_dsuid));
+  else
+    config_has_dsuids = false;
   if (config_lookup_string(&config, "libdsuid", (const char **) &sval))
     strncpy(g_lib_dsuid, sval, sizeof(g_lib_dsuid));
+  else
+    config_has_dsuids = false;
   if (config_lookup_int(&config, "reload_values", (int *) &ivalue))
     g_reload_values = ivalue;
   if (config_lookup_int(&config, "zone_id", (int *) &ivalue))
@@ -58,284 +386,127 @@ int read_config() {
       vdc_set_debugLevel(ivalue);
     }
   }
-  if (config_lookup_string(&config, "humifier.name", (const char **) &sval))
-    venta.humifier.name = strdup(sval);
-  if (config_lookup_string(&config, "humifier.id", (const char **) &sval)) {
-    venta.humifier.id = strdup(sval);
-  } else {
-    vdc_report(LOG_ERR, "mandatory parameter 'id' in section humifier: is not set in venta.cfg\n");  
-    exit(0);
-  }
-  if (config_lookup_string(&config, "humifier.ip", (const char **) &sval)) {
-    venta.humifier.ip = strdup(sval);
-  } else {
-    vdc_report(LOG_ERR, "mandatory parameter 'ip' in section humifier: is not set in venta.cfg\n");  
-    exit(0);
-  }
- 
-  char path[128];  
-  i = 0;
-  while(1) {
-    sprintf(path, "sensor_values.s%d", i);
-    if (i < MAX_SENSOR_VALUES && config_lookup(&config, path)) {
-      sensor_value_t* value = &venta.humifier.sensor_values[i];
-      
-      sprintf(path, "sensor_values.s%d.value_name", i);
-      if (config_lookup_string(&config, path, (const char **) &sval)) {
-        value->value_name = strdup(sval);  
-      } else {
-        value->value_name = strdup("");  
-      }
-      
-      sprintf(path, "sensor_values.s%d.sensor_type", i);
-      if (config_lookup_int(&config, path, (int *) &ivalue))
-        value->sensor_type = ivalue;  
-      
-      sprintf(path, "sensor_values.s%d.sensor_usage", i);
-      if (config_lookup_int(&config, path, (int *) &ivalue))
-        value->sensor_usage = ivalue;  
-      
-      value->is_active = true;
-      
-      i++;
-    } else {
-      while (i < MAX_SENSOR_VALUES) {
-        venta.humifier.sensor_values[i].is_active = false;
-        i++;
-      }        
-      break;
-    }
-  }
 
-  venta.humifier.configured_scenes = strdup("-");
-  i = 0;
-  while(1) {
-    sprintf(path, "humifier.scenes.s%d", i);
-    if (i < MAX_SCENES && config_lookup(&config, path)) {
-      scene_t* value = &venta.humifier.scenes[i];
-      
-      sprintf(path, "humifier.scenes.s%d.dsId", i);
-      config_lookup_int(&config, path, &ivalue);
-      value->dsId = ivalue;
-      char str[4];
-      sprintf(str, "%d", ivalue);
-      venta.humifier.configured_scenes = realloc(venta.humifier.configured_scenes, strlen(venta.humifier.configured_scenes)+4);
-      strcat(venta.humifier.configured_scenes, str);
-      strcat(venta.humifier.configured_scenes, "-");
-         
-      sprintf(path, "humifier.scenes.s%d.fan", i);
-      if (config_lookup_int(&config, path, &ivalue)) {
-        value->fan = ivalue;
-      } else {
-        value->fan = -1;
-      }
-      
-      sprintf(path, "humifier.scenes.s%d.mode_automatic", i);
-      if (config_lookup_int(&config, path, &ivalue)) {
-        value->mode_automatic = ivalue;
-      } else {
-        value->mode_automatic = -1;
-      }
-      
-      sprintf(path, "humifier.scenes.s%d.mode_sleep", i);
-      if (config_lookup_int(&config, path, &ivalue)) {
-        value->mode_sleep = ivalue;
-      } else {
-        value->mode_sleep = -1;
-      }
-      
-      i++;
-    } else {
-      while (i < MAX_SCENES) {
-        venta.humifier.scenes[i].dsId = -1;
-        i++;
-      }        
-      break;
+  config_setting_t *default_sensors = config_lookup(&config, "sensor_values");
+  config_setting_t *humifiers = config_lookup(&config, "humifiers");
+  config_setting_t *humifier = config_lookup(&config, "humifier");
+
+  config_includes = false;
+  if (humifiers != NULL) {
+    for (int i = 0; i < config_setting_length(humifiers); i++) {
+      errors += read_humifier(config_setting_get_elem(humifiers, i), default_sensors, i);
     }
+  } else if (humifier != NULL) {
+    errors += read_humifier(humifier, default_sensors, 0);
   }
+  config_destroy(&config);
 
-  if (g_cfgfile != NULL) {
-    config_destroy(&config);
+  sensor_table_t *t;
+  LL_FOREACH(sensor_tables, t) {
+    t->group = NULL;
   }
 
-  venta_humifier_t* humifier = &venta.humifier;
-  if (humifier->id) {
-    char buffer[128];
-    strcpy(buffer, humifier->id);
-    
-    humifier_device = malloc(sizeof(venta_vdcd_t));
-    if (!humifier_device) {
-      return VENTA_OUT_OF_MEMORY;
-    }
-    memset(humifier_device, 0, sizeof(venta_vdcd_t));
+  if (errors > 0) {
+    vdc_report(LOG_ERR, "%d errors in configuration %s\n", errors, g_cfgfile);
+    return -3;
+  }
+  if (humifier_device == NULL) {
+    vdc_report(LOG_WARNING, "no humifiers configured in %s\n", g_cfgfile);
+  }
+  venta_properties_build_vdc();
 
-    humifier_device->announced = false;
-    humifier_device->present = true; 
-    humifier_device->humifier = humifier;
+  return 0;
+}
 
-    dsuid_generate_v3_from_namespace(DSUID_NS_IEEE_MAC, buffer, &humifier_device->dsuid);
-    dsuid_to_string(&humifier_device->dsuid, humifier_device->dsuidstring);
+static config_setting_t* add_setting(config_setting_t *parent, const char *name, int type) {
+  config_setting_t *setting = config_setting_add(parent, name, type);
+  if (setting == NULL) {
+    setting = config_setting_get_member(parent, name);
   }
-
-	return 0;
+  return setting;
 }
 
-int write_config() {
-  config_t config;
-  config_setting_t* cfg_root;
-  config_setting_t* setting;
-  config_setting_t* humifiersetting;
+static void write_humifier(config_setting_t *humifiers, const venta_humifier_t *humifier, const venta_vdcd_t *dev) {
+  config_setting_t *humifiersetting = config_setting_add(humifiers, NULL, CONFIG_TYPE_GROUP);
+  char path[16];
   int i;
 
-  config_init(&config);
-  cfg_root = config_root_setting(&config);
+  config_setting_set_string(add_setting(humifiersetting, "id", CONFIG_TYPE_STRING), humifier->id ? humifier->id : "");
+  config_setting_set_string(add_setting(humifiersetting, "name", CONFIG_TYPE_STRING), humifier->name ? humifier->name : "");
+  config_setting_set_string(add_setting(humifiersetting, "ip", CONFIG_TYPE_STRING), humifier->ip ? humifier->ip : "");
 
-  setting = config_setting_add(cfg_root, "vdcdsuid", CONFIG_TYPE_STRING);
-  if (setting == NULL) {
-    setting = config_setting_get_member(cfg_root, "vdcdsuid");
-  }
-  config_setting_set_string(setting, g_vdc_dsuid);
-  
-  if (g_lib_dsuid != NULL && strcmp(g_lib_dsuid,"") != 0) { 
-    setting = config_setting_add(cfg_root, "libdsuid", CONFIG_TYPE_STRING);
-    if (setting == NULL) {
-      setting = config_setting_get_member(cfg_root, "libdsuid");
-    }  
-    config_setting_set_string(setting, g_lib_dsuid);
-  }
- 
-  setting = config_setting_add(cfg_root, "reload_values", CONFIG_TYPE_INT);
-  if (setting == NULL) {
-    setting = config_setting_get_member(cfg_root, "reload_values");
-  }
-  config_setting_set_int(setting, g_reload_values);
+  config_setting_t *scenes_path = add_setting(humifiersetting, "scenes", CONFIG_TYPE_GROUP);
+  for (i = 0; i < humifier->n_scenes; i++) {
+    const scene_t* value = &humifier->scenes[i];
 
-  setting = config_setting_add(cfg_root, "zone_id", CONFIG_TYPE_INT);
-  if (setting == NULL) {
-    setting = config_setting_get_member(cfg_root, "zone_id");
-  }
-  config_setting_set_int(setting, g_default_zoneID);
+    sprintf(path, "s%d", i);
+    config_setting_t *v = add_setting(scenes_path, path, CONFIG_TYPE_GROUP);
 
-  setting = config_setting_add(cfg_root, "debug", CONFIG_TYPE_INT);
-  if (setting == NULL) {
-    setting = config_setting_get_member(cfg_root, "debug");
+    config_setting_set_int(add_setting(v, "dsId", CONFIG_TYPE_INT), value->dsId);
+    if (value->fan > -1) {
+      config_setting_set_int(add_setting(v, "fan", CONFIG_TYPE_INT), value->fan);
+    }
+    if (value->mode_sleep > -1) {
+      config_setting_set_int(add_setting(v, "mode_sleep", CONFIG_TYPE_INT), value->mode_sleep);
+    }
+    if (value->mode_automatic > -1) {
+      config_setting_set_int(add_setting(v, "mode_automatic", CONFIG_TYPE_INT), value->mode_automatic);
+    }
   }
-  config_setting_set_int(setting, vdc_get_debugLevel());
 
-  humifiersetting = config_setting_add(cfg_root, "humifier", CONFIG_TYPE_GROUP);
-    
-  setting = config_setting_add(humifiersetting, "id", CONFIG_TYPE_STRING);
-  if (setting == NULL) {
-    setting = config_setting_get_member(humifiersetting, "id");
-  }
-  config_setting_set_string(setting, venta.humifier.id);
+  config_setting_t *sensor_values_path = add_setting(humifiersetting, "sensor_values", CONFIG_TYPE_GROUP);
+  for (i = 0; dev != NULL && i < dev->n_sensors; i++) {
+    const sensor_config_t* config = &dev->sensor_config[i];
 
-  setting = config_setting_add(humifiersetting, "name", CONFIG_TYPE_STRING);
-  if (setting == NULL) {
-    setting = config_setting_get_member(humifiersetting, "name");
-  }
-  config_setting_set_string(setting, venta.humifier.name);
-  
-  setting = config_setting_add(humifiersetting, "ip", CONFIG_TYPE_STRING);
-  if (setting == NULL) {
-    setting = config_setting_get_member(humifiersetting, "ip");
-  }
-  config_setting_set_string(setting, venta.humifier.ip);
-    
-  char path[128];
-  sprintf(path, "scenes");   
-  config_setting_t *scenes_path = config_setting_add(humifiersetting, path, CONFIG_TYPE_GROUP);
-  
-  if (scenes_path == NULL) {
-    scenes_path = config_setting_get_member(humifiersetting, path);
+    sprintf(path, "s%d", i);
+    config_setting_t *v = add_setting(sensor_values_path, path, CONFIG_TYPE_GROUP);
+
+    config_setting_set_string(add_setting(v, "value_name", CONFIG_TYPE_STRING), config->value_name);
+    config_setting_set_int(add_setting(v, "sensor_type", CONFIG_TYPE_INT), config->sensor_type);
+    config_setting_set_int(add_setting(v, "sensor_usage", CONFIG_TYPE_INT), config->sensor_usage);
+    config_setting_set_float(add_setting(v, "deadband", CONFIG_TYPE_FLOAT), config->deadband);
+    config_setting_set_int(add_setting(v, "min_push_interval", CONFIG_TYPE_INT), config->min_push_interval / 1000);
+    config_setting_set_int(add_setting(v, "alive_sign_interval", CONFIG_TYPE_INT), config->alive_sign_interval / 1000);
   }
+}
 
-  i = 0;
-  while(1) {
-    if (i < MAX_SCENES && venta.humifier.scenes[i].dsId != -1) {
-      scene_t* value = &venta.humifier.scenes[i];
-     
-      sprintf(path, "s%d", i);   
-      config_setting_t *v = config_setting_add(scenes_path, path, CONFIG_TYPE_GROUP);
+int write_config() {
+  config_t config;
+  config_setting_t* cfg_root;
+  venta_vdcd_t *dev;
 
-      if (v == NULL) {
-        v = config_setting_get_member(scenes_path, path);
-      }
-      
-      setting = config_setting_add(v, "dsId", CONFIG_TYPE_INT);
-      if (setting == NULL) {
-        setting = config_setting_get_member(v, "dsId");
-      }
-      config_setting_set_int(setting, value->dsId);      
-      
-      if (value->fan > -1) {
-        setting = config_setting_add(v, "fan", CONFIG_TYPE_INT);
-        if (setting == NULL) {
-          setting = config_setting_get_member(v, "fan");
-        }
-        config_setting_set_int(setting, value->fan);      
-      }
-      
-      if (value->mode_sleep > -1) {
-        setting = config_setting_add(v, "mode_sleep", CONFIG_TYPE_INT);
-        if (setting == NULL) {
-          setting = config_setting_get_member(v, "mode_sleep");
-        }
-        config_setting_set_int(setting, value->mode_sleep);      
-      }
-      
-      if (value->mode_automatic > -1) {
-        setting = config_setting_add(v, "mode_automatic", CONFIG_TYPE_INT);
-        if (setting == NULL) {
-          setting = config_setting_get_member(v, "mode_automatic");
-        }
-        config_setting_set_int(setting, value->mode_automatic);      
-      }
-      
-      i++;
+  if (config_includes) {
+    // libconfig cannot write @include directives back, rewriting would inline all device files
+    if (!config_has_dsuids) {
+      vdc_report(LOG_WARNING, "configuration %s uses include files and is not rewritten, add vdcdsuid = \"%s\"; libdsuid = \"%s\"; to keep the dSUIDs\n",
+          g_cfgfile, g_vdc_dsuid, g_lib_dsuid);
     } else {
-      break;
+      vdc_report(LOG_NOTICE, "configuration %s uses include files and is not rewritten, changes are kept until restart\n", g_cfgfile);
     }
+    return 0;
   }
-  
-  sprintf(path, "sensor_values");   
-  config_setting_t *sensor_values_path = config_setting_add(cfg_root, path, CONFIG_TYPE_GROUP);
 
-  if (sensor_values_path == NULL) {
-    sensor_values_path = config_setting_get_member(setting, path);
+  config_init(&config);
+  cfg_root = config_root_setting(&config);
+
+  config_setting_set_string(add_setting(cfg_root, "vdcdsuid", CONFIG_TYPE_STRING), g_vdc_dsuid);
+  if (g_lib_dsuid != NULL && strcmp(g_lib_dsuid,"") != 0) { 
+    config_setting_set_string(add_setting(cfg_root, "libdsuid", CONFIG_TYPE_STRING), g_lib_dsuid);
+  }
+  config_setting_set_int(add_setting(cfg_root, "reload_values", CONFIG_TYPE_INT), g_reload_values);
+  config_setting_set_int(add_setting(cfg_root, "zone_id", CONFIG_TYPE_INT), g_default_zoneID);
+  config_setting_set_int(add_setting(cfg_root, "debug", CONFIG_TYPE_INT), vdc_get_debugLevel());
+
+  config_setting_t *humifiers = add_setting(cfg_root, "humifiers", CONFIG_TYPE_LIST);
+  if (humifier_device == NULL) {
+    // template entry for a new configuration
+    venta_humifier_t empty;
+    memset(&empty, 0, sizeof(empty));
+    write_humifier(humifiers, &empty, NULL);
+  }
+  LL_FOREACH(humifier_device, dev) {
+    write_humifier(humifiers, dev->humifier, dev);
   }
-  
-  i = 0;
-  while(1) {
-    if (i < MAX_SENSOR_VALUES && venta.humifier.sensor_values[i].value_name != NULL) {
-      sensor_value_t* value = &venta.humifier.sensor_values[i];
-      
-      sprintf(path, "s%d", i);   
-      config_setting_t *v = config_setting_add(sensor_values_path, path, CONFIG_TYPE_GROUP);
-      
-      setting = config_setting_add(v, "value_name", CONFIG_TYPE_STRING);
-      if (setting == NULL) {
-        setting = config_setting_get_member(v, "value_name");
-      }
-      config_setting_set_string(setting, value->value_name);
-      
-      setting = config_setting_add(v, "sensor_type", CONFIG_TYPE_INT);
-      if (setting == NULL) {
-        setting = config_setting_get_member(v, "sensor_type");
-      }
-      config_setting_set_int(setting, value->sensor_type);
-      
-      setting = config_setting_add(v, "sensor_usage", CONFIG_TYPE_INT);
-      if (setting == NULL) {
-        setting = config_setting_get_member(v, "sensor_usage");
-      }
-      config_setting_set_int(setting, value->sensor_usage);
-      
-      i++;
-    } else {
-      break;
-    }   
-  } 
 
   char tmpfile[PATH_MAX];
   sprintf(tmpfile, "%s.cfg.new", g_cfgfile);
@@ -353,41 +524,88 @@ int write_config() {
   return 0;
 }
 
-sensor_value_t* find_sensor_value_by_name(char *key) {
-  sensor_value_t* value;
-  for (int i = 0; i < MAX_SENSOR_VALUES; i++) {
-    value = &venta.humifier.sensor_values[i];
-    if (value->value_name != NULL && strcasecmp(key, value->value_name) == 0) {
-        return value;
+sensor_value_t* find_sensor_value_by_name(venta_vdcd_t *dev, char *key) {
+  for (int i = 0; i < dev->n_sensors; i++) {
+    const char *name = dev->sensor_config[i].value_name;
+    if (name != NULL && strcasecmp(key, name) == 0) {
+        return &dev->sensors[i];
     }
   }
   
   return NULL;
 }
 
-void save_scene(int scene) {
-  int i = 0;
-  scene_t* value = NULL;
-  while(1) {
-    if (i < MAX_SCENES && venta.humifier.scenes[i].dsId != -1) {
-      //scene is already configured, so we will reconfigure the existing one
-      if (venta.humifier.scenes[i].dsId == scene) {
-        value = &venta.humifier.scenes[i];
-        break;
-      }
-    } else if (i < MAX_SCENES)  {
-      //scene is currently not configured and we have less than MAX_SCENES configured in config file, so we add a new scene config
-      value = &venta.humifier.scenes[i];
-      break;
-    } else {
+/*
+ * Configuration changes from callbacks are collected and written once after
+ * VENTA_CONFIG_WRITE_DELAY without further changes, so saving a scene on a whole
+ * zone rewrites the configuration file only once.
+ */
+void venta_config_changed() {
+  config_changes++;
+  config_write_time = vdc_clock_ms() + VENTA_CONFIG_WRITE_DELAY;
+}
+
+/* write a pending configuration change if it is due, or unconditionally on shutdown */
+void venta_config_flush(bool force) {
+  if (config_write_time == 0 || (!force && vdc_clock_ms() < config_write_time)) {
+    return;
+  }
+  config_write_time = 0;
+
+  if (g_simulation) {
+    vdc_report(LOG_NOTICE, "simulation: not writing %u configuration changes\n", config_changes);
+  } else {
+    vdc_report(LOG_NOTICE, "writing configuration after %u changes\n", config_changes);
+    write_config();
+  }
+  config_changes = 0;
+}
+
+/* store the device state last read by the poller as scene */
+void save_scene(venta_vdcd_t *dev, int scene) {
+  venta_state_t state;
+
+  if (scene < 0 || scene >= DS_SCENES) {
+    // read_scenes would reject the written configuration
+    vdc_report(LOG_WARNING, "save scene %d: scene number out of range\n", scene);
+    return;
+  }
+
+  pthread_mutex_lock(&g_network_mutex);
+  int rc = venta_get_cached_state(dev, &state);
+  pthread_mutex_unlock(&g_network_mutex);
+  if (rc != VENTA_OK) {
+    vdc_report(LOG_WARNING, "save scene %d: device state of %s not known yet\n", scene, dev->dsuidstring);
+    return;
+  }
+
+  venta_humifier_t *humifier = dev->humifier;
+  scene_t* value = get_scene_configuration(humifier, scene);
+
+  if (value == NULL) {
+    if (humifier->n_scenes >= MAX_SCENES) {
       //scene is not already configured in config file, but we have already MAX_SCENES configured in config file, so we ignore the save scene request
-      break;
+      vdc_report(LOG_WARNING, "save scene %d: maximum of %d scenes configured\n", scene, MAX_SCENES);
+      return;
     }
-    
-    i++;
-  }
-  
-  if (value != NULL) {
-    value->dsId = scene;
+    //scene is currently not configured, so we append a new scene config, the scene index holds positions and stays valid
+    scene_t *scenes = realloc(humifier->scenes, (humifier->n_scenes + 1) * sizeof(scene_t));
+    if (scenes == NULL) {
+      vdc_report(LOG_ERR, "save scene %d: out of memory\n", scene);
+      return;
+    }
+    humifier->scenes = scenes;
+    value = &humifier->scenes[humifier->n_scenes++];
+    memset(value, 0, sizeof(scene_t));
   }
+
+  value->dsId = scene;
+  value->fan = state.fan;
+  value->mode_sleep = state.mode_sleep;
+  value->mode_automatic = state.mode_automatic;
+  value->target = venta_compile_scene(value);
+  index_scene(humifier, value);
+
+  vdc_report(LOG_NOTICE, "save scene %d: fan %d sleep %d auto %d\n", scene, state.fan, state.mode_sleep, state.mode_automatic);
+  venta_config_changed();
 }
@@ -0,0 +1,425 @@
+/*
+ Author: Alexander Knauer <a-x-e@gmx.net>
+ License: Apache 2.0
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include <json.h>
+#include <utlist.h>
+
+#include <digitalSTROM/dsuid.h>
+#include <dsvdc/dsvdc.h>
+
+#include "venta.h"
+
+/*
+ * Device farm: n_devices virtual humifiers behind the device I/O interface, each an
+ * in-process model with a drifting humidity, a randomized request latency and a failure
+ * rate. Unlike the simulation mode the farm runs on the real clock with the real network
+ * thread, command threads and main loop push step, so it shows where the daemon stops
+ * keeping up. The main loop of the farm stands in for dSS: it calls scenes and queries
+ * properties at a fixed rate per device and accepts every push.
+ *
+ * The first configured humifier is the template for all farm devices.
+ */
+
+#define FARM_WORK_TIMEOUT 2000          /* ms, the dsvdc_work timeout of the real main loop */
+#define FARM_QUERY_INTERVAL 60000       /* ms, property queries per device */
+#define FARM_SCENE_INTERVAL 600000      /* ms, scene calls per device */
+
+typedef struct farm_model {
+  pthread_mutex_t lock;                 /* network thread and command thread of the device */
+  unsigned int seed;
+  double humidity;
+  double temperature;
+  int target_humidity;
+  venta_state_t state;
+  vdc_time_t updated;
+} farm_model_t;
+
+/* latency samples, in the unit given to sample_report */
+typedef struct farm_samples {
+  pthread_mutex_t lock;
+  double *v;
+  size_t n;
+  size_t size;
+} farm_samples_t;
+
+bool g_farm = false;
+
+static int farm_latency_ms;
+static double farm_failure;             /* probability of a failed request */
+
+static unsigned long farm_polls;
+static unsigned long farm_poll_failures;
+static unsigned long farm_commands;
+static unsigned long farm_pushes;
+static unsigned long farm_values;
+
+static farm_samples_t poll_lateness = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+static farm_samples_t push_latency = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+static farm_samples_t query_latency = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+static farm_samples_t scene_latency = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+
+static void sample_add(farm_samples_t *s, double value) {
+  pthread_mutex_lock(&s->lock);
+  if (s->n == s->size) {
+    size_t size = s->size ? s->size * 2 : 1024;
+    double *v = realloc(s->v, size * sizeof(double));
+    if (v == NULL) {
+      pthread_mutex_unlock(&s->lock);
+      return;
+    }
+    s->v = v;
+    s->size = size;
+  }
+  s->v[s->n++] = value;
+  pthread_mutex_unlock(&s->lock);
+}
+
+static int compare_samples(const void *a, const void *b) {
+  double da = *(const double *) a;
+  double db = *(const double *) b;
+  return (da > db) - (da < db);
+}
+
+static void sample_report(farm_samples_t *s, const char *name, const char *unit) {
+  if (s->n == 0) {
+    printf("# farm: %s no samples\n", name);
+    return;
+  }
+  qsort(s->v, s->n, sizeof(double), compare_samples);
+  printf("# farm: %s p50 %.1f %s, p90 %.1f %s, p99 %.1f %s, max %.1f %s (%zu samples)\n", name,
+      s->v[s->n / 2], unit, s->v[s->n * 9 / 10], unit, s->v[s->n * 99 / 100], unit, s->v[s->n - 1], unit, s->n);
+  free(s->v);
+  s->v = NULL;
+  s->n = s->size = 0;
+}
+
+static double uniform(unsigned int *seed) {
+  return rand_r(seed) / ((double) RAND_MAX + 1);
+}
+
+/* humidity moves towards the target while the fan runs and drifts randomly, temperature drifts */
+static void model_update(farm_model_t *model, vdc_time_t now) {
+  double dt = (now - model->updated) / 1000.0;
+
+  if (dt <= 0) {
+    return;
+  }
+  model->updated = now;
+  model->humidity += (model->target_humidity - model->humidity) * (1 - exp(-dt * model->state.fan / 1800.0));
+  model->humidity += (uniform(&model->seed) - 0.5) * sqrt(dt) * 0.4;
+  model->temperature += (uniform(&model->seed) - 0.5) * sqrt(dt) * 0.05;
+}
+
+static struct memory_struct* farm_response(const char *data) {
+  struct memory_struct *chunk = malloc(sizeof(struct memory_struct));
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->memory = strdup(data);
+  chunk->size = strlen(data);
+  return chunk;
+}
+
+static int body_int(const char *body, const char *key, int fallback) {
+  json_object *jobj = json_tokener_parse(body);
+  json_object *jval;
+  int value = fallback;
+
+  if (jobj != NULL && json_object_object_get_ex(jobj, key, &jval)) {
+    value = json_object_get_int(jval);
+  }
+  if (jobj != NULL) {
+    json_object_put(jobj);
+  }
+  return value;
+}
+
+static struct memory_struct* farm_request(venta_vdcd_t *dev, const char *path, const char *body) {
+  farm_model_t *model = dev->io_data;
+  vdc_time_t start = vdc_clock_ms();
+  vdc_time_t due = dev->next_poll;
+  char data[256];
+
+  pthread_mutex_lock(&model->lock);
+  int latency_ms = (int) (farm_latency_ms * (0.5 + uniform(&model->seed)));
+  bool failed = uniform(&model->seed) < farm_failure;
+  pthread_mutex_unlock(&model->lock);
+
+  if (latency_ms > 0) {
+    struct timespec delay = { latency_ms / 1000, (latency_ms % 1000) * 1000000 };
+    nanosleep(&delay, NULL);
+  }
+
+  if (strcmp(path, "/api/data") == 0) {
+    if (due != 0 && due <= start) {
+      sample_add(&poll_lateness, start - due);
+    }
+    if (failed) {
+      __sync_fetch_and_add(&farm_poll_failures, 1);
+      return NULL;
+    }
+    pthread_mutex_lock(&model->lock);
+    model_update(model, vdc_clock_ms());
+    snprintf(data, sizeof(data), "{\"device\":{\"hum\":%d,\"temp\":%d,\"humt\":%d,\"fan\":%d,\"sleep\":%d,\"auto\":%d}}",
+        (int) lround(model->humidity), (int) lround(model->temperature), model->target_humidity,
+        model->state.fan, model->state.mode_sleep, model->state.mode_automatic);
+    pthread_mutex_unlock(&model->lock);
+    __sync_fetch_and_add(&farm_polls, 1);
+    return farm_response(data);
+  }
+
+  if (failed) {
+    return NULL;
+  }
+  if (strcmp(path, "/api/btn") == 0 && body != NULL) {
+    int btn = body_int(body, "btn", -1);
+    pthread_mutex_lock(&model->lock);
+    model_update(model, vdc_clock_ms());
+    venta_button_apply(btn, &model->state);
+    pthread_mutex_unlock(&model->lock);
+    __sync_fetch_and_add(&farm_commands, 1);
+    return farm_response("{}");
+  }
+
+  vdc_report(LOG_WARNING, "farm: unhandled request %s\n", path);
+  return NULL;
+}
+
+static const venta_io_t farm_io = {
+  .name = "farm",
+  .request = farm_request
+};
+
+/* dSS side of a push, called by push_sensor_data with g_network_mutex held */
+void venta_farm_push(venta_vdcd_t *dev, uint32_t sensors) {
+  vdc_time_t now = vdc_clock_ms();
+
+  farm_pushes++;
+  for (int i = 0; i < dev->n_sensors; i++) {
+    if (!(sensors & (1u << i))) {
+      continue;
+    }
+    farm_values++;
+    // time from the poll that saw a new value to its push, alive signs are not counted
+    if (dev->sensors[i].value != dev->sensors[i].last_pushed || dev->sensors[i].last_reported == 0) {
+      sample_add(&push_latency, now - dev->sensors[i].last_query);
+    }
+  }
+}
+
+static double elapsed_us(const struct timespec *t0, const struct timespec *t1) {
+  return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+static double cpu_seconds(const struct rusage *ru) {
+  return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6 + ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+}
+
+/* a property query for the live states, as dSS sends it for the device views */
+static void farm_query(venta_vdcd_t *dev, const dsvdc_property_t *query) {
+  dsvdc_property_t *reply;
+  struct timespec t0, t1;
+
+  if (dsvdc_property_new(&reply) != DSVDC_OK) {
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  venta_vdcd_t *target;
+  if (venta_registry_lookup(dev->dsuidstring, &target) == VENTA_TARGET_DEVICE) {
+    venta_get_device_properties(target, reply, query);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  dsvdc_property_free(reply);
+  sample_add(&query_latency, elapsed_us(&t0, &t1));
+}
+
+static void farm_scene(venta_vdcd_t *dev, unsigned int *seed) {
+  struct timespec t0, t1;
+  char *dsuid = dev->dsuidstring;
+  venta_humifier_t *humifier = dev->humifier;
+
+  if (humifier->n_scenes == 0) {
+    return;
+  }
+  int scene = humifier->scenes[rand_r(seed) % humifier->n_scenes].dsId;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  vdc_callscene_cb(NULL, &dsuid, 1, scene, false, NULL, NULL, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  sample_add(&scene_latency, elapsed_us(&t0, &t1));
+}
+
+int venta_farm_run(int n_devices, int latency_ms, double failure_percent, vdc_time_t duration) {
+  venta_vdcd_t *template = humifier_device;
+  venta_vdcd_t **devices = calloc(n_devices, sizeof(venta_vdcd_t *));
+  farm_model_t *models = calloc(n_devices, sizeof(farm_model_t));
+  venta_vdcd_t *list = NULL;
+  dsvdc_property_t *query = NULL;
+  pthread_t network;
+  unsigned int seed = 1;
+  unsigned long queries = 0, scenes = 0;
+  int rc = 0;
+
+  if (devices == NULL || models == NULL || dsvdc_property_new(&query) != DSVDC_OK) {
+    free(devices);
+    free(models);
+    return VENTA_OUT_OF_MEMORY;
+  }
+  dsvdc_property_add_bool(query, "sensorStates", false);
+  dsvdc_property_add_bool(query, "channelStates", false);
+
+  farm_latency_ms = latency_ms;
+  farm_failure = failure_percent / 100.0;
+
+  for (int i = 0; i < n_devices; i++) {
+    char id[32];
+    venta_vdcd_t *dev = venta_device_new(template->humifier, template->sensor_config, template->n_sensors);
+    if (dev == NULL) {
+      rc = VENTA_OUT_OF_MEMORY;
+      n_devices = i;
+      break;
+    }
+    // sensor states of the template
+    memcpy(dev->sensors, template->sensors, template->n_sensors * sizeof(sensor_value_t));
+    snprintf(id, sizeof(id), "farm%04d", i);
+    dsuid_generate_v3_from_namespace(DSUID_NS_IEEE_MAC, id, &dev->dsuid);
+    dsuid_to_string(&dev->dsuid, dev->dsuidstring);
+    venta_properties_build(dev);
+
+    // as if announced and identified, the farm has no vdSM session
+    dev->bringup = VENTA_BRINGUP_ACTIVE;
+    dev->presentSignaled = true;
+
+    farm_model_t *model = &models[i];
+    pthread_mutex_init(&model->lock, NULL);
+    model->seed = i + 1;
+    model->humidity = 35 + 20 * uniform(&model->seed);
+    model->temperature = 19 + 4 * uniform(&model->seed);
+    model->target_humidity = 45 + rand_r(&model->seed) % 11;
+    model->state = (venta_state_t) { VENTA_FAN_MIN + rand_r(&model->seed) % VENTA_FAN_MAX, 0, 0 };
+    model->updated = vdc_clock_ms();
+    dev->io_data = model;
+
+    devices[i] = dev;
+    LL_APPEND(list, dev);
+  }
+
+  humifier_device = list;
+  venta_registry_build();
+  g_venta_io = &farm_io;
+  g_farm = true;
+
+  rc = venta_commands_start();
+  if (rc == 0 && pthread_create(&network, NULL, &networkThread, NULL) != 0) {
+    rc = -1;
+  }
+
+  struct rusage ru0, ru1;
+  struct timespec t0, t1;
+  getrusage(RUSAGE_SELF, &ru0);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  vdc_time_t start = vdc_clock_ms();
+  vdc_time_t end = start + duration;
+  vdc_time_t next_query = start;
+  vdc_time_t next_scene = start;
+  double query_interval = n_devices ? (double) FARM_QUERY_INTERVAL / n_devices : FARM_QUERY_INTERVAL;
+  double scene_interval = n_devices ? (double) FARM_SCENE_INTERVAL / n_devices : FARM_SCENE_INTERVAL;
+
+  while (rc == 0 && !g_shutdown_flag) {
+    vdc_time_t now = vdc_clock_ms();
+    if (now >= end) {
+      break;
+    }
+
+    // dSS messages, each wakes the main loop as it wakes dsvdc_work
+    for (; next_query <= now; next_query += (vdc_time_t) ceil(query_interval)) {
+      farm_query(devices[rand_r(&seed) % n_devices], query);
+      queries++;
+    }
+    for (; next_scene <= now; next_scene += (vdc_time_t) ceil(scene_interval)) {
+      farm_scene(devices[rand_r(&seed) % n_devices], &seed);
+      scenes++;
+    }
+
+    if (pthread_mutex_trylock(&g_network_mutex) == 0) {
+      venta_push_step();
+      pthread_mutex_unlock(&g_network_mutex);
+    }
+
+    vdc_time_t wakeup = now + FARM_WORK_TIMEOUT;
+    if (next_query < wakeup) {
+      wakeup = next_query;
+    }
+    if (next_scene < wakeup) {
+      wakeup = next_scene;
+    }
+    if (end < wakeup) {
+      wakeup = end;
+    }
+    now = vdc_clock_ms();
+    if (wakeup > now) {
+      struct timespec delay = { (wakeup - now) / 1000, ((wakeup - now) % 1000) * 1000000 };
+      nanosleep(&delay, NULL);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  getrusage(RUSAGE_SELF, &ru1);
+
+  g_shutdown_flag = 1;
+  venta_network_wakeup();
+  if (rc == 0) {
+    pthread_join(network, NULL);
+  }
+  venta_commands_stop();
+  unsigned long presses = 0;
+  for (int i = 0; i < n_devices; i++) {
+    presses += devices[i]->commands.presses;
+  }
+
+  double seconds = elapsed_us(&t0, &t1) / 1e6;
+  double cpu = cpu_seconds(&ru1) - cpu_seconds(&ru0);
+  if (rc == 0 && seconds > 0 && n_devices > 0) {
+    printf("# farm: %d devices, %d ms request latency, %.1f%% failed requests, %.0f s, poll interval %ld s\n",
+        n_devices, latency_ms, failure_percent, seconds, (long) g_reload_values);
+    printf("# farm: %lu polls (%.1f/s), %lu failed, %lu pushes with %lu values (%.1f/s), %lu requests for %lu presses\n",
+        farm_polls, farm_polls / seconds, farm_poll_failures, farm_pushes, farm_values, farm_pushes / seconds,
+        farm_commands, presses);
+    printf("# farm: %lu property queries, %lu scene calls\n", queries, scenes);
+    printf("# farm: CPU %.2f s (%.1f%% of one core), %.1f us per device per second\n",
+        cpu, 100 * cpu / seconds, cpu * 1e6 / seconds / n_devices);
+    printf("# farm: max RSS %ld KB, %.1f KB per device\n", ru1.ru_maxrss, (double) ru1.ru_maxrss / n_devices);
+    sample_report(&poll_lateness, "poll behind schedule", "ms");
+    sample_report(&push_latency, "poll to push of a new value", "ms");
+    sample_report(&query_latency, "property query", "us");
+    sample_report(&scene_latency, "scene call callback", "us");
+  }
+
+  humifier_device = template;
+  venta_registry_build();
+  g_farm = false;
+  for (int i = 0; i < n_devices; i++) {
+    venta_properties_free(devices[i]);
+    venta_commands_destroy(devices[i]);
+    free(devices[i]->sensors);
+    free(devices[i]);
+    pthread_mutex_destroy(&models[i].lock);
+  }
+  dsvdc_property_free(query);
+  free(devices);
+  free(models);
+  return rc;
+}
@@ -15,6 +15,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <math.h>
 
 #include <libconfig.h>
 #include <curl/curl.h>
@@ -31,9 +32,7 @@
 const char *g_cfgfile = "venta.cfg";
 const char *version = "0.0.1";
 int g_shutdown_flag = 0;
-venta_data_t venta;
 venta_vdcd_t* humifier_device = NULL;
-scene_t* humifier_current_values = NULL;
 
 /* VDC-API data */
 
@@ -47,15 +46,29 @@ char g_lib_dsuid[35] = { 0, };
 time_t g_reload_values = 1 * 60;
 int g_default_zoneID = 65534;
 
-static time_t g_query_values_time = 0;
-static bool g_network_changes = false;
 pthread_mutex_t g_network_mutex;
 
+/* wakeup of the network thread for immediate polls, the devices carry what is due */
+static pthread_mutex_t g_wakeup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_wakeup_cond;
+static bool g_wakeup_pending = false;
+
+/* startup timing */
+vdc_time_t g_process_start = 0;
+vdc_time_t g_first_poll_time = 0;
+vdc_time_t g_first_valid_reply = 0;       /* first sensorStates reply with a value for every sensor */
+
+unsigned long g_push_allocations = 0;      /* dsvdc properties allocated for sensor pushes */
+
 dsvdc_t *handle = NULL;
 
 #if defined(HAVE_GETOPT_H) && defined(HAVE_GETOPT_LONG)
 #include <getopt.h>
+#ifdef VENTA_SIMULATION
+#define OPTSTR "c:d:hs::D:B::RG::L::F::l:f:"
+#else
 #define OPTSTR "c:d:h"
+#endif
 #else
 #error Need getopt_long!
 #endif
@@ -64,6 +77,25 @@ void print_copyright() {
 }
 
 void print_usage() {
+#ifdef VENTA_SIMULATION
+  printf("usage: vdc-venta-sim [options]\n");
+#else
+  printf("usage: vdc-venta [options]\n");
+#endif
+  printf("  -c, --cfgfile=file          configuration file, default venta.cfg\n");
+  printf("  -d, --debuglevel=level      syslog level 0 (emergency) .. 7 (debug), default 4\n");
+  printf("  -h, --help                  show this help\n");
+#ifdef VENTA_SIMULATION
+  printf("  -s, --simulate[=script]     run against a simulated humifier on a virtual clock\n");
+  printf("  -D, --sim-duration=seconds  duration of a simulation or device farm run\n");
+  printf("  -B, --bench-fanout[=n]      time a zone scene call to n simulated humifiers, default 20\n");
+  printf("  -R, --bench-dimming         send a dimming ramp to one simulated humifier\n");
+  printf("  -G, --bench-getprop[=n]     time n device property queries, default 10000\n");
+  printf("  -L, --bench-config[=n]      time loading a configuration of n humifiers, default 500\n");
+  printf("  -F, --farm[=n]              run n virtual humifiers in real time, default 200\n");
+  printf("  -l, --farm-latency=ms       request latency of the device farm, default 50\n");
+  printf("  -f, --farm-failure=percent  failed requests of the device farm, default 1\n");
+#endif
 }
 
 void signal_handler(int signum) {
@@ -72,93 +104,326 @@ void signal_handler(int signum) {
   }
 }
 
-void* networkThread(void *arg __attribute__((unused))) {
+/* poll a device at once and push all its values, dev NULL refreshes all devices */
+void venta_request_refresh(venta_vdcd_t *dev) {
+  venta_vdcd_t *d;
+
+  pthread_mutex_lock(&g_wakeup_mutex);
+  LL_FOREACH(humifier_device, d) {
+    if (dev == NULL || d == dev) {
+      d->refresh_requested = true;
+    }
+  }
+  g_wakeup_pending = true;
+  pthread_cond_signal(&g_wakeup_cond);
+  pthread_mutex_unlock(&g_wakeup_mutex);
+}
+
+/* poll the device not later than when, used to confirm the optimistic state after a command */
+void venta_schedule_poll(venta_vdcd_t *dev, vdc_time_t when) {
+  pthread_mutex_lock(&g_wakeup_mutex);
+  if (dev->confirm_poll == 0 || when < dev->confirm_poll) {
+    dev->confirm_poll = when;
+  }
+  g_wakeup_pending = true;
+  pthread_cond_signal(&g_wakeup_cond);
+  pthread_mutex_unlock(&g_wakeup_mutex);
+}
+
+/* poll one device if due or requested, returns the deadline of its next poll */
+static vdc_time_t poll_device(venta_vdcd_t *dev, vdc_time_t now) {
+  bool refresh, confirm = false;
+  vdc_time_t next;
   int rc;
-  static time_t last = 0;
 
+  pthread_mutex_lock(&g_wakeup_mutex);
+  refresh = dev->refresh_requested;
+  dev->refresh_requested = false;
+  if (dev->confirm_poll != 0 && dev->confirm_poll <= now) {
+    confirm = true;
+    dev->confirm_poll = 0;
+  }
+  pthread_mutex_unlock(&g_wakeup_mutex);
+
+  if (refresh || confirm || (dev->next_poll <= now)) {
+    rc = venta_get_data(dev);
+    now = vdc_clock_ms();
+    if (rc == 0) {                 //getting values from Venta device succeeded and some values have changed compared to previous get values
+      dev->next_poll = g_reload_values * 1000 + now;
+      vdc_report(LOG_DEBUG, "changed values detected - sending to DSS\n");   // changed values are sent to upstream DSS by the push schedule
+    } else if (rc == 1) {         //getting values from Venta device succeeded but no values have changed compared to previous get values
+      dev->next_poll = g_reload_values * 1000 + now;
+      vdc_report(LOG_DEBUG, "Venta humifier values did not change - not sending to DSS\n");
+    } else {                                     //getting values from Venta device failed - retry in one minute
+      dev->next_poll = 60 * 1000 + now;
+      if (handle != NULL) {
+        dsvdc_send_pong(handle, dev->dsuidstring);
+      }
+    }
+
+    if (rc >= 0 && refresh) {
+      // a new session requested fresh values, queue all of them for the next push
+      vdc_time_t next_push;
+      pthread_mutex_lock(&g_network_mutex);
+      venta_outbox_put(dev, venta_sensors_due(dev, now, VENTA_PUSH_ALL, &next_push));
+      pthread_mutex_unlock(&g_network_mutex);
+    }
+
+    if (rc >= 0 && venta_confirm_state(dev)) {
+      vdc_report(LOG_DEBUG, "optimistic state corrected by poll\n");   // pushed as change by the push schedule
+    }
+
+    if (rc >= 0 && g_first_poll_time == 0) {
+      g_first_poll_time = now;
+      vdc_report(LOG_NOTICE, "startup: first poll completed %lld ms after process start\n", (long long) (g_first_poll_time - g_process_start));
+    }
+
+    char tsbuf[40];
+    vdc_report(LOG_DEBUG, "Network Thread: next poll of %s at %s\n", dev->dsuidstring, vdc_clock_format(dev->next_poll, tsbuf, sizeof(tsbuf)));
+  }
+
+  next = dev->next_poll;
+  pthread_mutex_lock(&g_wakeup_mutex);
+  if (dev->confirm_poll != 0 && dev->confirm_poll < next) {
+    next = dev->confirm_poll;
+  }
+  pthread_mutex_unlock(&g_wakeup_mutex);
+  return next;
+}
+
+/* poll all devices that are due or requested, returns the deadline of the next poll */
+vdc_time_t venta_poll_step(vdc_time_t now) {
+  venta_vdcd_t *dev;
+  vdc_time_t next = 0;
+
+  // requests arriving from here on wake the next wait
+  pthread_mutex_lock(&g_wakeup_mutex);
+  g_wakeup_pending = false;
+  pthread_mutex_unlock(&g_wakeup_mutex);
+
+  LL_FOREACH(humifier_device, dev) {
+    vdc_time_t due = poll_device(dev, now);
+    if (next == 0 || due < next) {
+      next = due;
+    }
+    now = vdc_clock_ms();
+  }
+  return (next != 0) ? next : now + g_reload_values * 1000;
+}
+
+/* wake the network thread, e.g. to let it see the shutdown flag */
+void venta_network_wakeup() {
+  pthread_mutex_lock(&g_wakeup_mutex);
+  pthread_cond_broadcast(&g_wakeup_cond);
+  pthread_mutex_unlock(&g_wakeup_mutex);
+}
+
+void* networkThread(void *arg __attribute__((unused))) {
   while (!g_shutdown_flag) {
-    sleep(5);
-    time_t now = time(NULL);
-  
-    if (now >= last + 10) {
-      vdc_report(LOG_DEBUG, "Network Thread: time %ld, last time %ld, queryValuesTime %d\n", now, last, g_query_values_time);
-
-      if ( (g_query_values_time <= now)) {        
-        rc = venta_get_data();
-        if (rc == 0) {                 //getting values from Venta device succeeded and some values have changed compared to previous get values
-          g_query_values_time = g_reload_values + now;
-          g_network_changes = true;                  // send to upstream DSS
-          vdc_report(LOG_DEBUG, "changed values detected - sending to DSS\n");
-        } else if (rc == 1) {         //getting values from Venta device succeeded but no values have changed compared to previous get values
-          g_query_values_time = g_reload_values + now;
-          g_network_changes = false;                 // no send to upstream DSS  
-          vdc_report(LOG_DEBUG, "Venta humifier values did not change - not sending to DSS\n");
-        } else {                                     //getting values from Venta device failed - retry in one minute
-          now = time(NULL);
-          g_query_values_time = 60 + now;
-          g_network_changes = false;                 // no send to upstream DSS  
-          dsvdc_send_pong(handle, humifier_device->dsuidstring);
+    vdc_time_t wakeup = venta_poll_step(vdc_clock_ms());
+
+    /* sleep until the next poll is due, a poll is requested or at most 5 seconds */
+    vdc_time_t now = vdc_clock_ms();
+    if (wakeup > now + 5000) {
+      wakeup = now + 5000;
+    }
+    if (wakeup > now) {
+      struct timespec deadline;
+      vdc_clock_timespec(wakeup, &deadline);
+      pthread_mutex_lock(&g_wakeup_mutex);
+      while (!g_wakeup_pending && !g_shutdown_flag) {
+        if (pthread_cond_timedwait(&g_wakeup_cond, &g_wakeup_mutex, &deadline) != 0) {
+          break;
         }
       }
-      last = now;
+      pthread_mutex_unlock(&g_wakeup_mutex);
     }
   }
 
   return NULL;
 }
 
-void announce_device() {
-  vdc_report(LOG_INFO, "Announcing device %p: %s...\n", humifier_device, humifier_device->dsuidstring);
-  int ret = dsvdc_announce_device(handle,
-                            g_vdc_dsuid,
-                            humifier_device->dsuidstring,
-                            (void *) NULL,
-                            vdc_announce_device_cb);
-  vdc_report(LOG_DEBUG, "Announce device return code: %d\n", ret);      
-  if (ret == DSVDC_OK) {
-    humifier_device->announced = true;
-  }
-}
+/*
+ * Push schedule per sensor: a value is pushed when it moved by more than the deadband since
+ * its last push, but not more often than its minimum push interval, and again shortly before
+ * its alive sign interval expires even if it did not change. Sensors past half of their alive
+ * sign interval join any push, so alive signs of several sensors share one push. Returns the
+ * sensors to push now as bit mask, next receives the time the next sensor becomes due.
+ */
+uint32_t venta_sensors_due(venta_vdcd_t *dev, vdc_time_t now, venta_push_mode_t mode, vdc_time_t *next) {
+  uint32_t due = 0;
 
-void push_sensor_data() {
-  dsvdc_property_t* pushEnvelope;
-  dsvdc_property_t* propState;  
-  dsvdc_property_t* propDevState;  
-  dsvdc_property_t* prop;
+  *next = INT64_MAX;
+  for (int i = 0; i < dev->n_sensors; i++) {
+    sensor_value_t *svalue = &dev->sensors[i];
+    sensor_config_t *config = &dev->sensor_config[i];
 
-  dsvdc_property_new (&pushEnvelope);
-  dsvdc_property_new (&propState);
-  dsvdc_property_new (&propDevState);
-  
-  int i = 0;
-  while (1) {
-    if (humifier_device->humifier->sensor_values[i].is_active) {
-      double val = humifier_device->humifier->sensor_values[i].value;
-      time_t now = time (NULL);
+    if (svalue->last_query == 0) {
+      // nothing polled yet
+      continue;
+    }
+    if (mode == VENTA_PUSH_ALL || svalue->last_reported == 0) {
+      due |= 1u << i;
+      continue;
+    }
 
-      if (dsvdc_property_new (&prop) != DSVDC_OK) {
-        vdc_report(LOG_ERR, "create new property failed!");
+    vdc_time_t when = svalue->last_reported + config->alive_sign_interval * 9 / 10;
+    if (fabs(svalue->value - svalue->last_pushed) > config->deadband) {
+      vdc_time_t allowed = svalue->last_reported + config->min_push_interval;
+      if (mode == VENTA_PUSH_CHANGED || allowed <= now) {
+        due |= 1u << i;
         continue;
       }
-      dsvdc_property_add_double (prop, "value", val);
-      dsvdc_property_add_int (prop, "age", now - humifier_device->humifier->sensor_values[i].last_query);
-      dsvdc_property_add_int (prop, "error", 0);
+      if (allowed < when) {
+        when = allowed;
+      }
+    }
+    if (when <= now) {
+      vdc_report(LOG_DEBUG, "push: alive sign for sensor %s\n", config->value_name);
+      due |= 1u << i;
+      continue;
+    }
+    if (when < *next) {
+      *next = when;
+    }
+  }
+
+  if (due) {
+    for (int i = 0; i < dev->n_sensors; i++) {
+      sensor_value_t *svalue = &dev->sensors[i];
+      if (svalue->last_query != 0 && svalue->last_reported + dev->sensor_config[i].alive_sign_interval / 2 <= now) {
+        due |= 1u << i;
+      }
+    }
+  }
 
-      char sensorIndex[64];
-      snprintf (sensorIndex, 64, "%d", i);
-      dsvdc_property_add_property (propState, sensorIndex, &prop);
+  return due;
+}
 
-      humifier_device->humifier->sensor_values[i].last_reported = now;
-      
-      i++;
-    } else {
-      break;
+/*
+ * Envelope for a sensorStates push of the sensors in *sensors: the envelope, the container
+ * and one property per sensor. libdsvdc cannot update a value in place or reuse a property
+ * once dsvdc_property_add_property took it over, so this is the minimum per push. Sensors
+ * whose property could not be allocated are cleared from *sensors.
+ */
+static dsvdc_property_t* build_sensor_push(venta_vdcd_t *dev, uint32_t *sensors, vdc_time_t now) {
+  dsvdc_property_t *pushEnvelope;
+  dsvdc_property_t *propState;
+  dsvdc_property_t *prop;
+  char sensorIndex[16];
+
+  if (dsvdc_property_new(&pushEnvelope) != DSVDC_OK) {
+    vdc_report(LOG_ERR, "push: allocating the envelope failed\n");
+    return NULL;
+  }
+  if (dsvdc_property_new(&propState) != DSVDC_OK) {
+    vdc_report(LOG_ERR, "push: allocating sensorStates failed\n");
+    dsvdc_property_free(pushEnvelope);
+    return NULL;
+  }
+  g_push_allocations += 2;
+
+  for (int i = 0; i < dev->n_sensors; i++) {
+    if (!(*sensors & (1u << i))) {
+      continue;
     }
+    if (dsvdc_property_new(&prop) != DSVDC_OK) {
+      vdc_report(LOG_ERR, "push: allocating sensor %d failed\n", i);
+      *sensors &= ~(1u << i);
+      continue;
+    }
+    g_push_allocations++;
+
+    dsvdc_property_add_double(prop, "value", dev->sensors[i].value);
+    dsvdc_property_add_double(prop, "age", (now - dev->sensors[i].last_query) / 1000.0);
+    dsvdc_property_add_int(prop, "error", 0);
+
+    snprintf(sensorIndex, sizeof(sensorIndex), "%d", i);
+    dsvdc_property_add_property(propState, sensorIndex, &prop);
   }
-  
-  dsvdc_property_add_property (pushEnvelope, "sensorStates", &propState);
-  dsvdc_push_property (handle, humifier_device->dsuidstring, pushEnvelope);
-  dsvdc_property_free (pushEnvelope);  
+
+  dsvdc_property_add_property(pushEnvelope, "sensorStates", &propState);
+  return pushEnvelope;
+}
+
+/*
+ * Push the sensors in *sensors, on return *sensors holds the sensors actually pushed.
+ * Returns VENTA_OK or an error if nothing could be pushed.
+ */
+int push_sensor_data(venta_vdcd_t *dev, uint32_t *sensors) {
+  vdc_time_t now = vdc_clock_ms();
+  int rc = VENTA_OK;
+
+  dsvdc_property_t *pushEnvelope = build_sensor_push(dev, sensors, now);
+  if (pushEnvelope == NULL) {
+    *sensors = 0;
+    return VENTA_OUT_OF_MEMORY;
+  }
+
+  if (g_simulation) {
+#ifdef VENTA_SIMULATION
+    if (g_farm) {
+      venta_farm_push(dev, *sensors);
+    } else if (simulation_trace_push(dev, *sensors) != VENTA_OK) {
+      *sensors = 0;
+      rc = VENTA_CONNECT_FAILED;
+    }
+#endif
+  } else if (dsvdc_push_property(handle, dev->dsuidstring, pushEnvelope) != DSVDC_OK) {
+    *sensors = 0;
+    rc = VENTA_CONNECT_FAILED;
+  }
+  dsvdc_property_free(pushEnvelope);
+
+  for (int i = 0; i < dev->n_sensors; i++) {
+    if (*sensors & (1u << i)) {
+      dev->sensors[i].last_reported = now;
+      dev->sensors[i].last_pushed = dev->sensors[i].value;
+    }
+  }
+  return rc;
+}
+
+/* presence and scheduled pushes of all active devices, called by the main loop with g_network_mutex held */
+void venta_push_step() {
+  venta_vdcd_t *dev;
+
+  LL_FOREACH(humifier_device, dev) {
+    if (dev->bringup != VENTA_BRINGUP_ACTIVE) {
+      continue;
+    }
+
+    if (!dev->present && dev->presentSignaled) {
+      dsvdc_device_vanished(handle, dev->dsuidstring);
+      dev->presentSignaled = false;
+    } else if (dev->present && !dev->presentSignaled) {
+      dsvdc_identify_device(handle, dev->dsuidstring);
+      dev->presentSignaled = true;
+    }
+
+    // changed values or alive signs due? initial and refreshed values are already in the outbox
+    vdc_time_t next_push;
+    venta_outbox_put(dev, venta_sensors_due(dev, vdc_clock_ms(), VENTA_PUSH_SCHEDULED, &next_push));
+    if (venta_outbox_depth(dev) > 0) {
+      vdc_report(LOG_INFO, "Reporting new values from device %p: %s...\n", dev, dev->dsuidstring);
+      venta_outbox_drain(dev);
+    }
+  }
+}
+
+/*
+ * Queue changed values outside of the push schedule, e.g. the optimistic state right after a
+ * command. Called from the command threads, which must not use libdsvdc, the next pass of the
+ * main loop sends them.
+ */
+void venta_push_changed(venta_vdcd_t *dev) {
+  vdc_time_t next;
+
+  pthread_mutex_lock(&g_network_mutex);
+  if (g_simulation || dev->bringup == VENTA_BRINGUP_ACTIVE) {
+    venta_outbox_put(dev, venta_sensors_due(dev, vdc_clock_ms(), VENTA_PUSH_CHANGED, &next));
+  }
+  pthread_mutex_unlock(&g_network_mutex);
 }
 
 int main(int argc __attribute__((unused)), char **argv __attribute__((unused))) {
@@ -167,15 +432,40 @@ int main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
 
   int o, opt_index;
   bool ready = false;
+#ifdef VENTA_SIMULATION
+  const char *sim_script = NULL;
+  int bench_devices = 0;
+  bool bench_dimming = false;
+  int bench_queries = 0;
+  int bench_config = 0;
+  int farm_devices = 0;
+  int farm_latency_ms = 50;
+  double farm_failure = 1;
+  bool sim_duration_set = false;
+  vdc_time_t sim_duration = 24 * 3600 * 1000;
+#endif
 
   static struct option long_options[] =
     {
         {"cfgfile",     1, 0, 'c'},
         {"debuglevel",  1, 0, 'd'},
         {"help",        0, 0, 'h'},
+#ifdef VENTA_SIMULATION
+        {"simulate",    2, 0, 's'},
+        {"sim-duration", 1, 0, 'D'},
+        {"bench-fanout", 2, 0, 'B'},
+        {"bench-dimming", 0, 0, 'R'},
+        {"bench-getprop", 2, 0, 'G'},
+        {"bench-config", 2, 0, 'L'},
+        {"farm", 2, 0, 'F'},
+        {"farm-latency", 1, 0, 'l'},
+        {"farm-failure", 1, 0, 'f'},
+#endif
         {0, 0, 0, 0}
     };
 
+  g_process_start = vdc_clock_ms();
+
   vdc_init_report();
   while (1) {
     o = getopt_long(argc, argv, OPTSTR, long_options, &opt_index);
@@ -188,6 +478,44 @@ int main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
       case 'd':
         vdc_set_debugLevel(atoi(optarg));
         break;
+      case 'h':
+        print_usage();
+        exit(EXIT_SUCCESS);
+#ifdef VENTA_SIMULATION
+      case 's':
+        g_simulation = true;
+        sim_script = optarg;
+        break;
+      case 'D':
+        sim_duration = (vdc_time_t) atol(optarg) * 1000;
+        sim_duration_set = true;
+        break;
+      case 'B':
+        g_simulation = true;
+        bench_devices = (optarg != NULL) ? atoi(optarg) : 20;
+        break;
+      case 'R':
+        g_simulation = true;
+        bench_dimming = true;
+        break;
+      case 'G':
+        g_simulation = true;
+        bench_queries = (optarg != NULL) ? atoi(optarg) : 10000;
+        break;
+      case 'L':
+        bench_config = (optarg != NULL) ? atoi(optarg) : 500;
+        break;
+      case 'F':
+        g_simulation = true;
+        farm_devices = (optarg != NULL) ? atoi(optarg) : 200;
+        break;
+      case 'l':
+        farm_latency_ms = atoi(optarg);
+        break;
+      case 'f':
+        farm_failure = atof(optarg);
+        break;
+#endif
       case 'v':
         print_copyright();
         exit(EXIT_SUCCESS);
@@ -212,9 +540,14 @@ int main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
     return EXIT_FAILURE;
   }
 
+#ifdef VENTA_SIMULATION
+  if (bench_config > 0) {
+    return (simulation_bench_config(bench_config) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+#endif
+
   curl_global_init(CURL_GLOBAL_ALL);
 
-  memset(&venta, 0, sizeof(venta_data_t));
   int rc = read_config();
   if (rc < -1) {
     vdc_report(LOG_ERR, "Could not read configuration data!\n");
@@ -225,9 +558,6 @@ int main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
     exit(0);
   }
 
-  char buffer[128] = { 0, };
-  strncpy(buffer, venta.humifier.id, 64);
-
   /* generate a dsuid v1 for the vdc */
   dsuid_t gdsuid;
   if (g_vdc_dsuid[0] == 0) {
@@ -242,17 +572,47 @@ int main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
     vdc_report(LOG_INFO, "Generated LIB DSUID: %s\n", g_lib_dsuid);
   }
 
+  /* callbacks resolve their dsuid through the registry */
+  if (venta_registry_build() != VENTA_OK) {
+    return EXIT_FAILURE;
+  }
+
   /* store configuration data, including the Venta device setup and the VDC DSUID */
-  if (write_config() < 0) {
+  if (!g_simulation && write_config() < 0) {
     vdc_report(LOG_ERR, "Could not write configuration data!\n");
   }
 
-   humifier_current_values = malloc(sizeof(scene_t));
-   if (!humifier_current_values) {
-    return VENTA_OUT_OF_MEMORY;
-   }
-   memset(humifier_current_values, 0, sizeof(scene_t));
-    
+  pthread_mutexattr_t mta;
+  pthread_mutexattr_init(&mta);
+  pthread_mutexattr_settype(&mta, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&g_network_mutex, &mta);
+  pthread_condattr_t cta;
+  pthread_condattr_init(&cta);
+  pthread_condattr_setclock(&cta, CLOCK_MONOTONIC);
+  pthread_cond_init(&g_wakeup_cond, &cta);
+
+#ifdef VENTA_SIMULATION
+  if (g_simulation) {
+    if (humifier_device == NULL) {
+      vdc_report(LOG_ERR, "simulation: no humifier configured\n");
+      return EXIT_FAILURE;
+    }
+    if (farm_devices > 0) {
+      rc = venta_farm_run(farm_devices, farm_latency_ms, farm_failure, sim_duration_set ? sim_duration : 60 * 1000);
+    } else if (bench_dimming) {
+      rc = simulation_bench_dimming(100);
+    } else if (bench_queries > 0) {
+      rc = simulation_bench_getprop(bench_queries);
+    } else if (bench_devices > 0) {
+      rc = simulation_bench_fanout(bench_devices, 100);
+    } else {
+      rc = simulation_run(sim_script, sim_duration);
+    }
+    curl_global_cleanup();
+    return (rc == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+#endif
+
   /* initialize new library instance */
   char hostname[HOST_NAME_MAX];
   gethostname(hostname, HOST_NAME_MAX);
@@ -277,23 +637,35 @@ int main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
   dsvdc_set_set_property_callback(handle, vdc_setprop_cb);
   dsvdc_set_call_scene_notification_callback(handle, vdc_callscene_cb);
   dsvdc_set_save_scene_notification_callback(handle, vdc_savescene_cb);
+  dsvdc_set_output_channel_value_callback(handle, vdc_output_channel_value_cb);
   dsvdc_set_send_request_generic_request(handle, vdc_request_generic_cb);
 
   /* delegate network access on a separate thread */
   /* avoid to block the dsvdc main loop and vdsm query timeouts */
-  pthread_mutexattr_t mta;
-  pthread_mutexattr_init(&mta);
-  pthread_mutexattr_settype(&mta, PTHREAD_MUTEX_RECURSIVE);
-  pthread_mutex_init(&g_network_mutex, &mta);
+  /* started once handle is set, the first poll still runs in parallel with the session setup by dsvdc_work() */
+  /* a failed start takes the shutdown path below, it stops what was started so far */
+  int exit_code = EXIT_SUCCESS;
+  bool network_started = false;
+  venta_vdcd_t *dev;
   if (pthread_create(&networkThreadId, NULL, &networkThread, 0) != 0) {
     vdc_report(LOG_ERR, "Network thread initialization failed\n");
-    return EXIT_FAILURE;
+    exit_code = EXIT_FAILURE;
+  } else {
+    network_started = true;
+    if (venta_commands_start() != 0) {
+      exit_code = EXIT_FAILURE;
+    }
+  }
+  if (exit_code != EXIT_SUCCESS) {
+    g_shutdown_flag++;
   }
 
   while (!g_shutdown_flag) {
     /* let the work function do our timing, 2secs timeout */
     dsvdc_work(handle, 2);
 
+    venta_config_flush(false);
+
     /* do not block here if network thread currently pulls new values,
      * push properties can wait and sent later if lock can be taken
      */
@@ -302,60 +674,38 @@ int main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
     }
 
     if (!dsvdc_has_session (handle)) {
-      humifier_device->announced = false;
-   
+      venta_session_lost();
       pthread_mutex_unlock(&g_network_mutex);
       continue;
     }
 
-    if (!humifier_device->announced) {
-      announce_device();
-      continue;
-    }
+    // retry announcements the vdSM rejected, devices are announced by the session callbacks
+    venta_announce_devices(handle);
 
-    if (!humifier_device->present) {
-      if(humifier_device->presentSignaled) {
-        dsvdc_device_vanished(handle, humifier_device->dsuidstring);
-        humifier_device->presentSignaled = false;
-        continue;
-      }
-    } else {
-      if (!humifier_device->presentSignaled) {
-        dsvdc_identify_device(handle, humifier_device->dsuidstring);
-        humifier_device->presentSignaled = true;
-        continue;
-      } 
-    }
-
-    // new data from the network?
-    if (g_network_changes) {
-      g_network_changes = false;
-
-      vdc_report(LOG_DEBUG, "Main loop: venta_device %p: - dsuid %s - presentSignaled %s, announced %s\n",
-            humifier_device, humifier_device->dsuidstring,
-            humifier_device->presentSignaled ? "yes" : "no",
-            humifier_device->announced? "yes" : "no"); 
-
-      vdc_report(LOG_INFO, "Reporting new values from device %p: %s...\n", humifier_device, humifier_device->dsuidstring);
-
-      push_sensor_data();
-    }
+    venta_push_step();
 
     pthread_mutex_unlock(&g_network_mutex);
   }
   
-  for (int i = 0; i < MAX_SENSOR_VALUES; i++) {
-    sensor_value_t* value = &venta.humifier.sensor_values[i];    
-    free(value->value_name);    
-  } 
-  
+  /* stop all users of the dsvdc handle and curl before they are released */
+  if (network_started) {
+    venta_network_wakeup();
+    pthread_join(networkThreadId, NULL);
+  }
+  venta_commands_stop();
 
-  free(humifier_current_values);
-  
+  venta_config_flush(true);
   dsvdc_cleanup(handle);
+  handle = NULL;
   curl_global_cleanup();
-  pthread_join(networkThreadId, NULL);
+
+  LL_FOREACH(humifier_device, dev) {
+    venta_commands_report(dev);
+    venta_outbox_report(dev);
+  }
+  venta_sensor_config_free();
   pthread_mutex_destroy(&g_network_mutex);
+  pthread_cond_destroy(&g_wakeup_cond);
 
-  return EXIT_SUCCESS;
+  return exit_code;
 }
@@ -24,11 +24,6 @@
 
 #include "venta.h"
 
-struct memory_struct {
-  char *memory;
-  size_t size;
-};
-
 struct data {
   char trace_ascii; /* 1 or 0 */
 };
@@ -142,7 +137,7 @@ int decodeURIComponent (char *sSource, char *sDest) {
   return nLength;
 }
 
-struct memory_struct* http_post(const char *url, json_object *jsondata) {
+struct memory_struct* http_post(const char *url, const char *body) {
   CURL *curl;
   CURLcode res;
   struct memory_struct *chunk;
@@ -171,8 +166,8 @@ struct memory_struct* http_post(const char *url, json_object *jsondata) {
 
   curl_easy_setopt(curl, CURLOPT_POST, 1);
 
-  if(jsondata != NULL) {
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_object_to_json_string(jsondata));
+  if(body != NULL) {
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
     headers = curl_slist_append(headers, "Content-Type: application/json");
   } /*else {
     vdc_report(LOG_ERR, "network: post data missing");
@@ -239,11 +234,31 @@ struct memory_struct* http_post(const char *url, json_object *jsondata) {
   return chunk;
 }
 
-int parse_json_data(struct memory_struct *response) {
+static struct memory_struct* http_request(venta_vdcd_t *dev, const char *path, const char *body) {
+  char url[100] = "http://";
+  strcat(url, dev->humifier->ip);
+  strcat(url, path);
+
+  return http_post(url, body);
+}
+
+static const venta_io_t http_io = {
+  .name = "http",
+  .request = http_request
+};
+
+const venta_io_t *g_venta_io = &http_io;
+
+static struct memory_struct* venta_request(venta_vdcd_t *dev, const char *path, json_object *jsondata) {
+  return g_venta_io->request(dev, path, jsondata != NULL ? json_object_to_json_string(jsondata) : NULL);
+}
+
+int parse_json_data(venta_vdcd_t *dev, struct memory_struct *response) {
+  scene_t *current_values = &dev->current_values;
   bool changed_values = FALSE;
-  time_t now;
+  vdc_time_t now;
     
-  now = time(NULL);
+  now = vdc_clock_ms();
   vdc_report(LOG_DEBUG, "network: venta humifier values response = %s\n", response->memory);
   
   json_object *jobj = json_tokener_parse(response->memory);
@@ -253,7 +268,8 @@ int parse_json_data(struct memory_struct *response) {
     return VENTA_GETMEASURE_FAILED;
   }
 
-  //pthread_mutex_lock(&g_network_mutex);
+  // the response is parsed, only applying the values needs the lock
+  pthread_mutex_lock(&g_network_mutex);
 
   json_object_object_foreach(jobj, key, val) {
     enum json_type type = json_object_get_type(val);
@@ -264,29 +280,25 @@ int parse_json_data(struct memory_struct *response) {
       json_object_object_foreach(val, key1, val1) {
         enum json_type type1 = json_object_get_type(val1);
         if (strcmp(key1, "hum") == 0) {
-          humifier_current_values->current_humidity = json_object_get_int(val1);
+          current_values->current_humidity = json_object_get_int(val1);
         } else if (strcmp(key1, "temp") == 0)  {
-          humifier_current_values->current_temperature = json_object_get_int(val1);
+          current_values->current_temperature = json_object_get_int(val1);
         } else if (strcmp(key1, "humt") == 0)  {
-          humifier_current_values->target_humidity = json_object_get_int(val1);
+          current_values->target_humidity = json_object_get_int(val1);
         } else if (strcmp(key1, "auto") == 0)  {
-          humifier_current_values->mode_automatic = json_object_get_int(val1);
+          current_values->mode_automatic = json_object_get_int(val1);
         } else if (strcmp(key1, "sleep") == 0)  {
-          humifier_current_values->mode_sleep = json_object_get_int(val1);
+          current_values->mode_sleep = json_object_get_int(val1);
         } else if (strcmp(key1, "fan") == 0)  {
-          humifier_current_values->fan = json_object_get_int(val1);
+          current_values->fan = json_object_get_int(val1);
         }
-    
-        vdc_report(LOG_INFO, "current_hum %d\n", humifier_current_values->current_humidity);
-        vdc_report(LOG_INFO, "current_temp %d\n", humifier_current_values->current_temperature);
-        vdc_report(LOG_INFO, "target_hum %d\n", humifier_current_values->target_humidity);
-    
-        svalue = find_sensor_value_by_name(key1);
+
+        svalue = find_sensor_value_by_name(dev, key1);
         if (svalue == NULL) {
-          vdc_report(LOG_WARNING, "value %s is not configured for evaluation - ignoring\n", key1);
+          vdc_report(LOG_DEBUG, "value %s is not configured for evaluation - ignoring\n", key1);
         } else {
           if (type1 == json_type_int) {
-            vdc_report(LOG_WARNING, "network: getdata returned %s: %d\n", key1, json_object_get_int(val1));
+            vdc_report(LOG_DEBUG, "network: getdata returned %s: %d\n", key1, json_object_get_int(val1));
         
             //if ((svalue->last_reported == 0) || (svalue->last_value != json_object_get_int(val)) || (now - svalue->last_reported) > 180) {
             if ((svalue->last_reported == 0) || (svalue->last_value != json_object_get_int(val1))) {
@@ -296,7 +308,7 @@ int parse_json_data(struct memory_struct *response) {
             svalue->value = json_object_get_int(val1);
             svalue->last_query = now;
           } else if (type1 == json_type_boolean) {
-            vdc_report(LOG_WARNING, "network: getmeasure returned %s: %s\n", key, json_object_get_boolean(val1)? "true": "false");
+            vdc_report(LOG_DEBUG, "network: getdata returned %s: %s\n", key1, json_object_get_boolean(val1)? "true": "false");
           
             //if ((svalue->last_reported == 0) || (svalue->last_value != json_object_get_boolean(val)) || (now - svalue->last_reported) > 180) {
             if ((svalue->last_reported == 0) || (svalue->last_value != json_object_get_boolean(val1))) {
@@ -311,7 +323,7 @@ int parse_json_data(struct memory_struct *response) {
     }
   }
 
-	pthread_mutex_unlock(&g_network_mutex);
+  pthread_mutex_unlock(&g_network_mutex);
   
   json_object_put(jobj);
    
@@ -320,157 +332,27 @@ int parse_json_data(struct memory_struct *response) {
   } else return 1;
 }
 
-bool is_scene_configured(int scene) {
-  char scene_str[5];
-  sprintf(scene_str, "-%d-", scene);
-  if (strstr(venta.humifier.configured_scenes, scene_str) != NULL) {
-    return TRUE;
-  } else return FALSE;
-}
+int venta_change_fan(venta_vdcd_t *dev, int fan) {
+  venta_state_t target = { fan, -1, -1 };
 
-scene_t* get_scene_configuration(int scene) {
-  scene_t *scene_data;
-  int v;
-  
-  scene_data = malloc(sizeof(scene_t));
-  if (!scene_data) {
-    return NULL;
-  }
-  memset(scene_data, 0, sizeof(scene_t));
-  
-  v = 0;
-  while (1) {
-    if (&venta.humifier.scenes[v] != NULL) {
-      if (venta.humifier.scenes[v].dsId == scene) {
-        scene_data->fan = venta.humifier.scenes[v].fan;
-        scene_data->mode_automatic = venta.humifier.scenes[v].mode_automatic;
-        scene_data->mode_sleep = venta.humifier.scenes[v].mode_sleep;
-        break;
-      }
-      
-      v++;
-    } else {
-      break;
-    }
-  }
-    
-  return scene_data;
-}
-
-int venta_set_fan(int btn_val) {
-  int rc;
-  char url[100] = "http://";
-  strcat(url, venta.humifier.ip);
-  strcat(url, "/api/btn");
-  
-  vdc_report(LOG_NOTICE, "network: changing Venta Humifier fan speed btn val %d\n", btn_val);
-  
-  json_object *json1; 
+  vdc_report(LOG_NOTICE, "network: changing Venta Humifier fan level to %d\n", fan);
 
-  json_object *jint_btn = json_object_new_int(btn_val);
-    
-  json1 = json_object_new_object();
-
-  json_object_object_add(json1,"btn", jint_btn);
-    
-  struct memory_struct *response = http_post(url, json1);
-  
-  //free mem
-  json_object_put(json1);
-  
-  if (response == NULL) {
-    vdc_report(LOG_ERR, "Venta config change failed\n");
-    return VENTA_CONFIGCHANGE_FAILED;
-  } 
-    
-  free(response->memory);
-  free(response);
-  
-}
-
-int venta_set_mode_sleep(bool on) {
-  int rc;
-  char url[100] = "http://";
-  strcat(url, venta.humifier.ip);
-  strcat(url, "/api/btn");
-  
-  vdc_report(LOG_NOTICE, "network: setting sleep mode for Venta Humifier\n");
-  
-  venta_get_data();
-  
-  if ((!humifier_current_values->mode_sleep && on) || (humifier_current_values->mode_sleep && !on)) {
-    json_object *json1; 
-
-    json_object *jint_btn = json_object_new_int(5);
-      
-    json1 = json_object_new_object();
-
-    json_object_object_add(json1,"btn", jint_btn);
-      
-    struct memory_struct *response = http_post(url, json1);
-    
-    //free mem
-    json_object_put(json1);
-    
-    if (response == NULL) {
-      vdc_report(LOG_ERR, "Venta config change failed\n");
-      return VENTA_CONFIGCHANGE_FAILED;
-    } 
-      
-    free(response->memory);
-    free(response);
-  }    
-}
-
-int venta_set_mode_automatic(bool on) {
-  int rc;
-  char url[100] = "http://";
-  strcat(url, venta.humifier.ip);
-  strcat(url, "/api/btn");
-  
-  vdc_report(LOG_NOTICE, "network: setting sleep mode for Venta Humifier\n");
-  
-  venta_get_data();
-  if ((!humifier_current_values->mode_automatic && on) || (humifier_current_values->mode_automatic && !on)) {
-    json_object *json1; 
-
-    json_object *jint_btn = json_object_new_int(6);
-      
-    json1 = json_object_new_object();
-
-    json_object_object_add(json1,"btn", jint_btn);
-      
-    struct memory_struct *response = http_post(url, json1);
-    
-    //free mem
-    json_object_put(json1);
-    
-    if (response == NULL) {
-      vdc_report(LOG_ERR, "Venta config change failed\n");
-      return VENTA_CONFIGCHANGE_FAILED;
-    } 
-      
-    free(response->memory);
-    free(response);
-  }
+  return venta_apply_state(dev, &target);
 }
   
-int venta_get_data() {
+int venta_get_data(venta_vdcd_t *dev) {
   int rc;
-  char url[100] = "http://";
-  strcat(url, venta.humifier.ip);
-  strcat(url, "/api/data");
 
   vdc_report(LOG_NOTICE, "network: reading Venta Humifier values\n");
   
-  struct memory_struct *response = http_post(url, NULL);
+  struct memory_struct *response = venta_request(dev, "/api/data", NULL);
   
   if (response == NULL) {
     vdc_report(LOG_ERR, "network: getting humifier values failed\n");
     return VENTA_CONNECT_FAILED;
   }
   
-  rc = parse_json_data(response);
+  rc = parse_json_data(dev, response);
   
   free(response->memory);
   free(response);
@@ -0,0 +1,127 @@
+/*
+ Author: Alexander Knauer <a-x-e@gmx.net>
+ License: Apache 2.0
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <digitalSTROM/dsuid.h>
+#include <dsvdc/dsvdc.h>
+
+#include "venta.h"
+
+/*
+ * Per device outbox for sensor pushes. The push schedule and session refreshes queue
+ * sensors, the main loop drains the outbox whenever the session accepts pushes. There is
+ * one slot per sensor: an update queued while an older one is still unsent replaces it,
+ * so the outbox never holds more than MAX_SENSOR_VALUES entries however long dSS stalls.
+ * A failed push keeps the entries and backs off before the next attempt.
+ *
+ * All functions are called with g_network_mutex held.
+ */
+
+static int count_sensors(uint32_t sensors) {
+  int n = 0;
+  for (; sensors; sensors &= sensors - 1) {
+    n++;
+  }
+  return n;
+}
+
+void venta_outbox_put(venta_vdcd_t *dev, uint32_t sensors) {
+  venta_outbox_t *outbox = &dev->outbox;
+  vdc_time_t now = vdc_clock_ms();
+
+  for (int i = 0; i < dev->n_sensors; i++) {
+    if (!(sensors & (1u << i))) {
+      continue;
+    }
+    double value = dev->sensors[i].value;
+
+    if (outbox->pending & (1u << i)) {
+      if (outbox->value[i] != value) {
+        outbox->coalesced++;
+        outbox->value[i] = value;
+      }
+      continue;
+    }
+    outbox->pending |= 1u << i;
+    outbox->value[i] = value;
+    outbox->queued[i] = now;
+    outbox->enqueued++;
+  }
+
+  int depth = count_sensors(outbox->pending);
+  if (depth > outbox->depth_max) {
+    outbox->depth_max = depth;
+  }
+}
+
+/* push all pending sensors in one envelope, returns the number of sensors sent */
+int venta_outbox_drain(venta_vdcd_t *dev) {
+  venta_outbox_t *outbox = &dev->outbox;
+  vdc_time_t now = vdc_clock_ms();
+
+  if (outbox->pending == 0 || now < outbox->retry_at) {
+    return 0;
+  }
+
+  uint32_t sent = outbox->pending;
+  if (push_sensor_data(dev, &sent) != VENTA_OK) {
+    outbox->failed++;
+    outbox->backoff = (outbox->backoff == 0) ? VENTA_OUTBOX_BACKOFF : outbox->backoff * 2;
+    if (outbox->backoff > VENTA_OUTBOX_BACKOFF_MAX) {
+      outbox->backoff = VENTA_OUTBOX_BACKOFF_MAX;
+    }
+    outbox->retry_at = now + outbox->backoff;
+    vdc_report(LOG_WARNING, "outbox: push of %d sensors for %s failed, retry in %lld ms\n",
+        count_sensors(outbox->pending), dev->dsuidstring, (long long) outbox->backoff);
+    return 0;
+  }
+
+  for (int i = 0; i < MAX_SENSOR_VALUES; i++) {
+    if ((sent & (1u << i)) && now - outbox->queued[i] > outbox->delay_max) {
+      outbox->delay_max = now - outbox->queued[i];
+    }
+  }
+  outbox->pending &= ~sent;
+  outbox->backoff = 0;
+  outbox->retry_at = 0;
+
+  int n = count_sensors(sent);
+  outbox->sent += n;
+  return n;
+}
+
+/* discard pending updates that can no longer be delivered, e.g. when the session ended */
+void venta_outbox_drop(venta_vdcd_t *dev, const char *reason) {
+  venta_outbox_t *outbox = &dev->outbox;
+
+  if (outbox->pending == 0) {
+    return;
+  }
+  int n = count_sensors(outbox->pending);
+  outbox->dropped += n;
+  outbox->pending = 0;
+  outbox->backoff = 0;
+  outbox->retry_at = 0;
+  vdc_report(LOG_NOTICE, "outbox: dropped %d pending sensor updates for %s: %s\n", n, dev->dsuidstring, reason);
+}
+
+int venta_outbox_depth(venta_vdcd_t *dev) {
+  return count_sensors(dev->outbox.pending);
+}
+
+void venta_outbox_report(venta_vdcd_t *dev) {
+  venta_outbox_t *outbox = &dev->outbox;
+
+  vdc_report(LOG_NOTICE, "outbox %s: %lu queued, %lu coalesced, %lu sent, %lu failed pushes, %lu dropped, depth %d (max %d), max delay %lld ms\n",
+      dev->dsuidstring, outbox->enqueued, outbox->coalesced, outbox->sent, outbox->failed, outbox->dropped,
+      venta_outbox_depth(dev), outbox->depth_max, (long long) outbox->delay_max);
+}
@@ -0,0 +1,475 @@
+/*
+ Author: Alexander Knauer <a-x-e@gmx.net>
+ License: Apache 2.0
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <utlist.h>
+
+#include <digitalSTROM/dsuid.h>
+#include <dsvdc/dsvdc.h>
+
+#include "venta.h"
+
+#include "incbin.h"
+INCBIN_EXTERN(VentaHumifier16);
+INCBIN_EXTERN(VentaHumifier48);
+
+/*
+ * Static getprop answers. Properties whose value never changes at runtime are described by
+ * constant templates, properties derived from the configuration are formatted once into a
+ * cache when the configuration is read. A query only instantiates the template into the
+ * reply, no formatting, hostname lookup or config walk happens per request.
+ *
+ * libdsvdc has no way to share or clone a property tree, dsvdc_property_add_property takes
+ * ownership of the subtree, so the reply elements themselves are still created per query.
+ */
+
+typedef enum {
+  PT_NONE,                                /* known property without a value, answered empty */
+  PT_BOOL,
+  PT_UINT,
+  PT_DOUBLE,
+  PT_STRING,
+  PT_BYTES,
+  PT_GROUP
+} prop_type_t;
+
+typedef struct prop_template {
+  const char *name;
+  prop_type_t type;
+  union {
+    bool b;
+    uint64_t u;
+    double d;
+    const char *s;
+    struct {
+      const uint8_t *data;
+      const unsigned int *size;
+    } bytes;
+    const struct prop_template *sub;      /* PT_GROUP: children, terminated by a NULL name */
+  } v;
+} prop_template_t;
+
+#define T_NONE(n)       { n, PT_NONE,   { .u = 0 } }
+#define T_BOOL(n, x)    { n, PT_BOOL,   { .b = x } }
+#define T_UINT(n, x)    { n, PT_UINT,   { .u = x } }
+#define T_DOUBLE(n, x)  { n, PT_DOUBLE, { .d = x } }
+#define T_STRING(n, x)  { n, PT_STRING, { .s = x } }
+#define T_GROUP(n, x)   { n, PT_GROUP,  { .sub = x } }
+#define T_END           { NULL, PT_NONE, { .u = 0 } }
+
+#define T_ACTION(var, id, title) \
+  static const prop_template_t var[] = { \
+    T_STRING("id", "dynamic." id), \
+    T_STRING("action", "dynamic." id), \
+    T_STRING("title", title), \
+    T_STRING("description", title), \
+    T_END \
+  }
+
+T_ACTION(action_turn_on,        "ActTurnOn",       "01-Einschalten");
+T_ACTION(action_turn_off,       "ActTurnOff",      "02-Ausschalten");
+T_ACTION(action_fan1,           "ActFan1",         "03-Fanspeed 1");
+T_ACTION(action_fan2,           "ActFan2",         "04-Fanspeed 2");
+T_ACTION(action_fan3,           "ActFan3",         "05-Fanspeed 3");
+T_ACTION(action_sleep_on,       "ActSleepModeOn",  "06-Schlafmodus an");
+T_ACTION(action_sleep_off,      "ActSleepModeOff", "07-Schlafmodus aus");
+T_ACTION(action_auto_on,        "ActAutoModeOn",   "08-Automatikmodus an");
+T_ACTION(action_auto_off,       "ActAutoModeOff",  "09-Automatikmodus aus");
+
+static const prop_template_t dynamic_actions[] = {
+  T_GROUP("ActTurnOn", action_turn_on),
+  T_GROUP("ActTurnOff", action_turn_off),
+  T_GROUP("ActFan1", action_fan1),
+  T_GROUP("ActFan2", action_fan2),
+  T_GROUP("ActFan3", action_fan3),
+  T_GROUP("ActSleepModeOn", action_sleep_on),
+  T_GROUP("ActSleepModeOff", action_sleep_off),
+  T_GROUP("ActAutoModeOn", action_auto_on),
+  T_GROUP("ActAutoModeOff", action_auto_off),
+  T_END
+};
+
+static const prop_template_t output_description[] = {
+  T_STRING("name", "Venta Humifier"),
+  T_UINT("defaultGroup", 8),
+  T_UINT("function", 0),
+  T_UINT("outputUsage", 1),
+  T_BOOL("variableRamp", true),
+  T_UINT("maxPower", 100),
+  T_END
+};
+
+static const prop_template_t output_groups[] = {
+  T_BOOL("0", true),
+  T_BOOL("3", true),
+  T_END
+};
+
+static const prop_template_t output_settings[] = {
+  T_GROUP("groups", output_groups),
+  T_UINT("mode", 1),
+  T_BOOL("pushChanges", true),
+  T_END
+};
+
+static const prop_template_t channel_fan[] = {
+  T_STRING("name", "fan level"),
+  T_UINT("channelType", VENTA_CHANNEL_TYPE_FAN),
+  T_DOUBLE("min", VENTA_FAN_MIN),
+  T_DOUBLE("max", VENTA_FAN_MAX),
+  T_DOUBLE("resolution", 1),
+  T_END
+};
+
+static const prop_template_t channel_descriptions[] = {
+  T_GROUP("0", channel_fan),
+  T_END
+};
+
+static const prop_template_t model_features[] = {
+  T_BOOL("dontcare", false),
+  T_BOOL("blink", false),
+  T_BOOL("outmode", false),
+  T_BOOL("jokerconfig", true),
+  T_END
+};
+
+/* vDSD properties identical for all humifiers */
+static const prop_template_t device_properties[] = {
+  T_UINT("primaryGroup", 8),
+  T_NONE("buttonInputDescriptions"),
+  T_NONE("buttonInputSettings"),
+  T_GROUP("dynamicActionDescriptions", dynamic_actions),
+  T_GROUP("outputDescription", output_description),
+  T_GROUP("outputSettings", output_settings),
+  T_GROUP("channelDescriptions", channel_descriptions),
+  T_NONE("channelSettings"),
+  T_NONE("deviceStates"),
+  T_NONE("deviceProperties"),
+  T_NONE("devicePropertyDescriptions"),
+  T_NONE("customActions"),
+  T_NONE("binaryInputDescriptions"),
+  T_NONE("binaryInputSettings"),
+  T_NONE("binaryInputStates"),
+  T_STRING("type", "vDSD"),
+  T_STRING("model", "Humifier"),
+  T_GROUP("modelFeatures", model_features),
+  T_STRING("modelUID", "Venta Humifier"),
+  T_STRING("modelVersion", "0"),
+  T_NONE("deviceClass"),
+  T_NONE("deviceClassVersion"),
+  T_NONE("oemGuid"),
+  T_NONE("oemModelGuid"),
+  T_STRING("vendorId", "vendor: Venta"),
+  T_STRING("vendorName", "Venta"),
+  T_STRING("hardwareVersion", "0.0.0"),
+  T_STRING("configURL", ""),
+  T_STRING("hardwareModelGuid", ""),
+  { "deviceIcon16", PT_BYTES, { .bytes = { gVentaHumifier16Data, &gVentaHumifier16Size } } },
+  { "deviceIcon48", PT_BYTES, { .bytes = { gVentaHumifier48Data, &gVentaHumifier48Size } } },
+  T_STRING("deviceIconName", "venta-humifier-16.png"),
+  T_END
+};
+
+static const prop_template_t vdc_capabilities[] = {
+  T_BOOL("metering", false),
+  T_BOOL("dynamicDefinitions", true),
+  T_END
+};
+
+static const prop_template_t vdc_properties[] = {
+  T_NONE("vendorId"),
+  T_NONE("oemGuid"),
+  T_STRING("implementationId", "Venta Humifier"),
+  T_STRING("modelUID", "Venta Humifier"),
+  T_STRING("modelGuid", "Venta Humifier"),
+  T_GROUP("capabilities", vdc_capabilities),
+  T_NONE("configURL"),
+  T_END
+};
+
+/* vDSD properties derived from the humifier configuration */
+struct venta_property_cache {
+  const prop_template_t *index[VENTA_PROP_COUNT];
+  prop_template_t properties[4];
+  prop_template_t sensor_descriptions[MAX_SENSOR_VALUES + 1];
+  prop_template_t sensor_description[MAX_SENSOR_VALUES][5];
+  prop_template_t sensor_settings[MAX_SENSOR_VALUES + 1];
+  prop_template_t sensor_setting[MAX_SENSOR_VALUES][4];
+  char sensor_name[MAX_SENSOR_VALUES][64];
+  char sensor_index[MAX_SENSOR_VALUES][8];
+  char vendor_guid[128];
+};
+
+/* vDC properties derived from the configuration and the host */
+static struct {
+  bool valid;
+  const prop_template_t *index[VENTA_PROP_COUNT];
+  prop_template_t properties[4];
+  char hardware_guid[128];
+  char display_id[128];
+  char name[256];
+  char model[HOST_NAME_MAX + 32];
+} vdc_cache;
+
+/*
+ * Property names are resolved by a perfect hash: the seed of an FNV-1a hash is chosen so
+ * that all known names land in distinct slots, a lookup is one hash and one strcmp to
+ * reject unknown names. The seed below is collision free for VENTA_PROPERTY_NAMES, when
+ * the list changes the next working seed is searched on first use.
+ */
+
+#define PROPERTY_SLOTS 128                /* power of two, more than twice the number of names */
+#define PROPERTY_HASH_SEED 4401
+
+#define VENTA_PROPERTY_STRING(n) #n,
+
+static const char *property_names[VENTA_PROP_COUNT] = {
+  VENTA_PROPERTY_NAMES(VENTA_PROPERTY_STRING)
+};
+
+static uint8_t property_slots[PROPERTY_SLOTS];     /* property id + 1, 0 for an empty slot */
+static uint32_t property_seed;
+static const prop_template_t *device_index[VENTA_PROP_COUNT];
+static const prop_template_t *vdc_index[VENTA_PROP_COUNT];
+static pthread_once_t property_tables_once = PTHREAD_ONCE_INIT;
+
+static uint32_t property_hash(uint32_t seed, const char *name) {
+  uint32_t h = 2166136261u ^ seed;
+
+  for (; *name; name++) {
+    h ^= (uint8_t) *name;
+    h *= 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+
+static bool build_property_slots(uint32_t seed) {
+  memset(property_slots, 0, sizeof(property_slots));
+  for (int p = 0; p < VENTA_PROP_COUNT; p++) {
+    uint32_t slot = property_hash(seed, property_names[p]) & (PROPERTY_SLOTS - 1);
+    if (property_slots[slot] != 0) {
+      return false;
+    }
+    property_slots[slot] = p + 1;
+  }
+  return true;
+}
+
+static venta_property_t lookup_property(const char *name) {
+  int p = property_slots[property_hash(property_seed, name) & (PROPERTY_SLOTS - 1)] - 1;
+  if (p < 0 || strcmp(property_names[p], name) != 0) {
+    return VENTA_PROP_UNKNOWN;
+  }
+  return p;
+}
+
+static void build_index(const prop_template_t **index, const prop_template_t *t) {
+  for (; t->name != NULL; t++) {
+    venta_property_t id = lookup_property(t->name);
+    if (id == VENTA_PROP_UNKNOWN) {
+      vdc_report(LOG_ERR, "properties: template %s missing in VENTA_PROPERTY_NAMES\n", t->name);
+      continue;
+    }
+    index[id] = t;
+  }
+}
+
+static void build_property_tables() {
+  property_seed = PROPERTY_HASH_SEED;
+  while (!build_property_slots(property_seed)) {
+    property_seed++;
+  }
+  if (property_seed != PROPERTY_HASH_SEED) {
+    vdc_report(LOG_INFO, "properties: hash seed %u is not collision free, using %u\n", PROPERTY_HASH_SEED, property_seed);
+  }
+
+  build_index(device_index, device_properties);
+  build_index(vdc_index, vdc_properties);
+}
+
+const char* venta_property_name(venta_property_t id) {
+  return (id < VENTA_PROP_COUNT) ? property_names[id] : NULL;
+}
+
+venta_property_t venta_property_lookup(const char *name) {
+  pthread_once(&property_tables_once, build_property_tables);
+  return lookup_property(name);
+}
+
+static void add_template(dsvdc_property_t *property, const prop_template_t *t) {
+  for (; t->name != NULL; t++) {
+    switch (t->type) {
+      case PT_NONE:
+        break;
+      case PT_BOOL:
+        dsvdc_property_add_bool(property, t->name, t->v.b);
+        break;
+      case PT_UINT:
+        dsvdc_property_add_uint(property, t->name, t->v.u);
+        break;
+      case PT_DOUBLE:
+        dsvdc_property_add_double(property, t->name, t->v.d);
+        break;
+      case PT_STRING:
+        dsvdc_property_add_string(property, t->name, t->v.s);
+        break;
+      case PT_BYTES:
+        dsvdc_property_add_bytes(property, t->name, t->v.bytes.data, *t->v.bytes.size);
+        break;
+      case PT_GROUP: {
+        dsvdc_property_t *sub;
+        if (dsvdc_property_new(&sub) != DSVDC_OK) {
+          vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", t->name);
+          break;
+        }
+        add_template(sub, t->v.sub);
+        dsvdc_property_add_property(property, t->name, &sub);
+        break;
+      }
+    }
+  }
+}
+
+/* add a single template entry, groups are added with their children */
+static void add_entry(dsvdc_property_t *property, const prop_template_t *t) {
+  prop_template_t one[2] = { *t, T_END };
+  add_template(property, one);
+}
+
+void venta_properties_build(venta_vdcd_t *dev) {
+  venta_humifier_t *humifier = dev->humifier;
+  struct venta_property_cache *c = dev->properties;
+
+  if (c == NULL) {
+    c = malloc(sizeof(struct venta_property_cache));
+    if (c == NULL) {
+      vdc_report(LOG_ERR, "properties: out of memory for %s\n", dev->dsuidstring);
+      return;
+    }
+    dev->properties = c;
+  }
+  memset(c, 0, sizeof(struct venta_property_cache));
+
+  int n = 0;
+  for (int i = 0; i < dev->n_sensors; i++, n++) {
+    sensor_config_t *config = &dev->sensor_config[i];
+
+    snprintf(c->sensor_name[i], sizeof(c->sensor_name[i]), "%s-%s", humifier->name, config->value_name);
+    snprintf(c->sensor_index[i], sizeof(c->sensor_index[i]), "%d", i);
+
+    prop_template_t *d = c->sensor_description[i];
+    d[0] = (prop_template_t) T_STRING("name", c->sensor_name[i]);
+    d[1] = (prop_template_t) T_UINT("sensorType", config->sensor_type);
+    d[2] = (prop_template_t) T_UINT("sensorUsage", config->sensor_usage);
+    d[3] = (prop_template_t) T_DOUBLE("aliveSignInterval", config->alive_sign_interval / 1000.0);
+    c->sensor_descriptions[i] = (prop_template_t) T_GROUP(c->sensor_index[i], d);
+
+    prop_template_t *s = c->sensor_setting[i];
+    s[0] = (prop_template_t) T_UINT("group", 8);
+    s[1] = (prop_template_t) T_UINT("minPushInterval", config->min_push_interval / 1000);
+    s[2] = (prop_template_t) T_DOUBLE("changesOnlyInterval", config->min_push_interval / 1000.0);
+    c->sensor_settings[i] = (prop_template_t) T_GROUP(c->sensor_index[i], s);
+  }
+
+  snprintf(c->vendor_guid, sizeof(c->vendor_guid), "Venta vDC %s", humifier->id);
+
+  c->properties[0] = (prop_template_t) T_STRING("name", humifier->name);
+  c->properties[1] = (prop_template_t) T_STRING("vendorGuid", c->vendor_guid);
+  c->properties[2] = (prop_template_t) T_GROUP("sensorDescriptions", c->sensor_descriptions);
+  c->properties[3] = (prop_template_t) T_GROUP("sensorSettings", c->sensor_settings);
+
+  pthread_once(&property_tables_once, build_property_tables);
+  memcpy(c->index, device_index, sizeof(c->index));
+  c->index[VENTA_PROP_name] = &c->properties[0];
+  c->index[VENTA_PROP_vendorGuid] = &c->properties[1];
+  c->index[VENTA_PROP_sensorDescriptions] = &c->properties[2];
+  c->index[VENTA_PROP_sensorSettings] = &c->properties[3];
+
+  vdc_report(LOG_INFO, "properties: cached static answers for %s, %d sensors\n", dev->dsuidstring, n);
+}
+
+void venta_properties_build_vdc() {
+  char hostname[HOST_NAME_MAX + 1];
+
+  if (gethostname(hostname, sizeof(hostname)) != 0) {
+    strcpy(hostname, "localhost");
+  }
+  hostname[HOST_NAME_MAX] = 0;
+
+  // the vDC is identified by its first device, a fleet is named by its size
+  venta_vdcd_t *dev;
+  int n = 0;
+  LL_FOREACH(humifier_device, dev) {
+    n++;
+  }
+  const char *id = (humifier_device != NULL) ? humifier_device->humifier->id : "";
+  snprintf(vdc_cache.hardware_guid, sizeof(vdc_cache.hardware_guid), "humifier-id:%s", id);
+  if (n == 1) {
+    snprintf(vdc_cache.display_id, sizeof(vdc_cache.display_id), "%s", id);
+    snprintf(vdc_cache.name, sizeof(vdc_cache.name), "Venta Humifier %s", humifier_device->humifier->name);
+  } else {
+    snprintf(vdc_cache.display_id, sizeof(vdc_cache.display_id), "%d humifiers", n);
+    snprintf(vdc_cache.name, sizeof(vdc_cache.name), "Venta Humifiers");
+  }
+  snprintf(vdc_cache.model, sizeof(vdc_cache.model), "Venta Humifier Controller @%s", hostname);
+
+  vdc_cache.properties[0] = (prop_template_t) T_STRING("hardwareGuid", vdc_cache.hardware_guid);
+  vdc_cache.properties[1] = (prop_template_t) T_STRING("displayId", vdc_cache.display_id);
+  vdc_cache.properties[2] = (prop_template_t) T_STRING("name", vdc_cache.name);
+  vdc_cache.properties[3] = (prop_template_t) T_STRING("model", vdc_cache.model);
+
+  pthread_once(&property_tables_once, build_property_tables);
+  memcpy(vdc_cache.index, vdc_index, sizeof(vdc_cache.index));
+  vdc_cache.index[VENTA_PROP_hardwareGuid] = &vdc_cache.properties[0];
+  vdc_cache.index[VENTA_PROP_displayId] = &vdc_cache.properties[1];
+  vdc_cache.index[VENTA_PROP_name] = &vdc_cache.properties[2];
+  vdc_cache.index[VENTA_PROP_model] = &vdc_cache.properties[3];
+  vdc_cache.valid = true;
+}
+
+void venta_properties_free(venta_vdcd_t *dev) {
+  free(dev->properties);
+  dev->properties = NULL;
+}
+
+/*
+ * Add the static answer for a vDSD property to property. Returns false if the property is
+ * not answered from the cache, the caller handles it as a live value.
+ */
+bool venta_properties_add(venta_vdcd_t *dev, dsvdc_property_t *property, venta_property_t id) {
+  if (dev->properties == NULL) {
+    venta_properties_build(dev);
+    if (dev->properties == NULL) {
+      return false;
+    }
+  }
+
+  if (id >= VENTA_PROP_COUNT || dev->properties->index[id] == NULL) {
+    return false;
+  }
+  add_entry(property, dev->properties->index[id]);
+  return true;
+}
+
+bool venta_properties_add_vdc(dsvdc_property_t *property, venta_property_t id) {
+  if (!vdc_cache.valid) {
+    venta_properties_build_vdc();
+  }
+
+  if (id >= VENTA_PROP_COUNT || vdc_cache.index[id] == NULL) {
+    return false;
+  }
+  add_entry(property, vdc_cache.index[id]);
+  return true;
+}
@@ -0,0 +1,138 @@
+/*
+ Author: Alexander Knauer <a-x-e@gmx.net>
+ License: Apache 2.0
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utlist.h>
+
+#include <digitalSTROM/dsuid.h>
+#include <dsvdc/dsvdc.h>
+
+#include "venta.h"
+
+/*
+ * dSUID index for the callbacks: the dSUIDs of the vDC, the library and all devices are
+ * parsed once into binary form and kept in an open addressing hash table. A callback
+ * parses its dSUID string and resolves it with one hash, independent of the number of
+ * devices. The table is rebuilt when the device list changes.
+ */
+
+typedef struct venta_dsuid_entry {
+  dsuid_t dsuid;
+  venta_target_t target;
+  venta_vdcd_t *dev;
+} venta_dsuid_entry_t;
+
+static venta_dsuid_entry_t *dsuid_table = NULL;
+static size_t dsuid_slots = 0;                /* power of two, at least twice the number of entries */
+
+static uint32_t dsuid_hash(const dsuid_t *dsuid) {
+  uint32_t h = 2166136261u;
+
+  for (int i = 0; i < DSUID_SIZE; i++) {
+    h ^= dsuid->id[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void dsuid_insert(const char *dsuidstring, venta_target_t target, venta_vdcd_t *dev) {
+  dsuid_t dsuid;
+
+  if (dsuidstring[0] == 0) {
+    return;
+  }
+  if (dsuid_from_string(dsuidstring, &dsuid) != 0) {
+    vdc_report(LOG_WARNING, "registry: invalid dsuid %s\n", dsuidstring);
+    return;
+  }
+
+  size_t slot = dsuid_hash(&dsuid) & (dsuid_slots - 1);
+  while (dsuid_table[slot].target != VENTA_TARGET_NONE) {
+    if (memcmp(&dsuid_table[slot].dsuid, &dsuid, sizeof(dsuid_t)) == 0) {
+      vdc_report(LOG_WARNING, "registry: duplicate dsuid %s\n", dsuidstring);
+      return;
+    }
+    slot = (slot + 1) & (dsuid_slots - 1);
+  }
+  dsuid_table[slot].dsuid = dsuid;
+  dsuid_table[slot].target = target;
+  dsuid_table[slot].dev = dev;
+}
+
+/* (re)build the index from g_vdc_dsuid, g_lib_dsuid and the device list */
+int venta_registry_build() {
+  venta_vdcd_t *dev;
+  size_t entries = 2;
+
+  LL_FOREACH(humifier_device, dev) {
+    entries++;
+  }
+
+  size_t slots = 16;
+  while (slots < entries * 2) {
+    slots *= 2;
+  }
+
+  venta_dsuid_entry_t *table = calloc(slots, sizeof(venta_dsuid_entry_t));
+  if (table == NULL) {
+    vdc_report(LOG_ERR, "registry: out of memory for %zu entries\n", entries);
+    return VENTA_OUT_OF_MEMORY;
+  }
+  free(dsuid_table);
+  dsuid_table = table;
+  dsuid_slots = slots;
+
+  dsuid_insert(g_vdc_dsuid, VENTA_TARGET_VDC, NULL);
+  dsuid_insert(g_lib_dsuid, VENTA_TARGET_LIB, NULL);
+  LL_FOREACH(humifier_device, dev) {
+    dsuid_insert(dev->dsuidstring, VENTA_TARGET_DEVICE, dev);
+  }
+  return VENTA_OK;
+}
+
+void venta_registry_free() {
+  free(dsuid_table);
+  dsuid_table = NULL;
+  dsuid_slots = 0;
+}
+
+/* resolve a dSUID string, dev receives the device for VENTA_TARGET_DEVICE */
+venta_target_t venta_registry_lookup(const char *dsuidstring, venta_vdcd_t **dev) {
+  dsuid_t dsuid;
+
+  if (dev != NULL) {
+    *dev = NULL;
+  }
+  if (dsuid_table == NULL || dsuidstring == NULL || dsuid_from_string(dsuidstring, &dsuid) != 0) {
+    return VENTA_TARGET_NONE;
+  }
+
+  size_t slot = dsuid_hash(&dsuid) & (dsuid_slots - 1);
+  while (dsuid_table[slot].target != VENTA_TARGET_NONE) {
+    if (memcmp(&dsuid_table[slot].dsuid, &dsuid, sizeof(dsuid_t)) == 0) {
+      if (dev != NULL) {
+        *dev = dsuid_table[slot].dev;
+      }
+      return dsuid_table[slot].target;
+    }
+    slot = (slot + 1) & (dsuid_slots - 1);
+  }
+  return VENTA_TARGET_NONE;
+}
+
+venta_vdcd_t* find_device_by_dsuid(const char *dsuid) {
+  venta_vdcd_t *dev;
+
+  if (venta_registry_lookup(dsuid, &dev) != VENTA_TARGET_DEVICE) {
+    return NULL;
+  }
+  return dev;
+}
@@ -0,0 +1,255 @@
+/*
+ Author: Alexander Knauer <a-x-e@gmx.net>
+ License: Apache 2.0
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <digitalSTROM/dsuid.h>
+#include <dsvdc/dsvdc.h>
+
+#include "venta.h"
+
+/*
+ * Button semantics of the Venta humifier as a state machine over (fan, sleep, automatic).
+ * Scenes are compiled into a target state when the configuration is read, at call time
+ * the shortest press sequence from the cached device state to the target is searched.
+ */
+
+static void fan_up(venta_state_t *state) {
+  if (state->fan < VENTA_FAN_MAX) state->fan++;
+}
+
+static void fan_down(venta_state_t *state) {
+  if (state->fan > VENTA_FAN_MIN) state->fan--;
+}
+
+static void toggle_sleep(venta_state_t *state) {
+  state->mode_sleep = !state->mode_sleep;
+}
+
+static void toggle_automatic(venta_state_t *state) {
+  state->mode_automatic = !state->mode_automatic;
+}
+
+typedef struct venta_button {
+  int btn;
+  const char *body;                       /* pre-serialized request body for /api/btn */
+  void (*apply)(venta_state_t *state);
+} venta_button_t;
+
+static const venta_button_t buttons[VENTA_BUTTONS] = {
+  { 3, "{\"btn\":3}", fan_up },
+  { 4, "{\"btn\":4}", fan_down },
+  { 5, "{\"btn\":5}", toggle_sleep },
+  { 6, "{\"btn\":6}", toggle_automatic }
+};
+
+#define VENTA_STATES ((VENTA_FAN_MAX - VENTA_FAN_MIN + 1) * 2 * 2)
+
+static uint8_t transitions[VENTA_STATES][VENTA_BUTTONS];
+static pthread_once_t transitions_once = PTHREAD_ONCE_INIT;
+
+static int state_index(const venta_state_t *state) {
+  return ((state->fan - VENTA_FAN_MIN) * 2 + state->mode_sleep) * 2 + state->mode_automatic;
+}
+
+static venta_state_t state_from_index(int index) {
+  venta_state_t state;
+  state.mode_automatic = index % 2;
+  state.mode_sleep = (index / 2) % 2;
+  state.fan = index / 4 + VENTA_FAN_MIN;
+  return state;
+}
+
+bool venta_state_matches(const venta_state_t *state, const venta_state_t *target) {
+  return (target->fan < 0 || target->fan == state->fan) &&
+         (target->mode_sleep < 0 || target->mode_sleep == state->mode_sleep) &&
+         (target->mode_automatic < 0 || target->mode_automatic == state->mode_automatic);
+}
+
+static void build_transitions() {
+  for (int i = 0; i < VENTA_STATES; i++) {
+    for (int b = 0; b < VENTA_BUTTONS; b++) {
+      venta_state_t state = state_from_index(i);
+      buttons[b].apply(&state);
+      transitions[i][b] = state_index(&state);
+    }
+  }
+}
+
+bool venta_state_valid(const venta_state_t *state) {
+  return state->fan >= VENTA_FAN_MIN && state->fan <= VENTA_FAN_MAX &&
+         (state->mode_sleep == 0 || state->mode_sleep == 1) &&
+         (state->mode_automatic == 0 || state->mode_automatic == 1);
+}
+
+/* effect of a physical button on a state, used by the simulation model */
+void venta_button_apply(int btn, venta_state_t *state) {
+  for (int b = 0; b < VENTA_BUTTONS; b++) {
+    if (buttons[b].btn == btn) {
+      buttons[b].apply(state);
+      return;
+    }
+  }
+}
+
+bool is_scene_configured(venta_humifier_t *humifier, int scene) {
+  if (scene < 0 || scene >= DS_SCENES) {
+    return false;
+  }
+  return humifier->scene_index[scene] != 0;
+}
+
+scene_t* get_scene_configuration(venta_humifier_t *humifier, int scene) {
+  if (!is_scene_configured(humifier, scene)) {
+    return NULL;
+  }
+  return &humifier->scenes[humifier->scene_index[scene] - 1];
+}
+
+/* make a configured scene available for lookup by its dS scene number */
+void index_scene(venta_humifier_t *humifier, scene_t *scene) {
+  if (scene->dsId < 0 || scene->dsId >= DS_SCENES) {
+    vdc_report(LOG_WARNING, "scene: dsId %d out of range, ignoring\n", scene->dsId);
+    return;
+  }
+  humifier->scene_index[scene->dsId] = scene - humifier->scenes + 1;
+}
+
+/* target state of a configured scene, -1 marks values the scene does not change */
+venta_state_t venta_compile_scene(const scene_t *scene) {
+  venta_state_t target = { -1, -1, -1 };
+
+  if (scene->mode_sleep > 0) {
+    target.mode_sleep = 1;
+    target.fan = VENTA_FAN_MIN;             // sleep mode runs on the lowest fan level unless the scene sets one
+  } else if (scene->mode_sleep == 0) {
+    target.mode_sleep = 0;
+  }
+
+  if (scene->mode_automatic > 0) {
+    target.mode_automatic = 1;
+  } else if (scene->mode_automatic == 0) {
+    target.mode_automatic = 0;
+  }
+
+  if (scene->fan >= VENTA_FAN_MIN && scene->fan <= VENTA_FAN_MAX) {
+    target.fan = scene->fan;
+  }
+
+  return target;
+}
+
+/*
+ * Breadth first search for the shortest sequence of button presses leading from current
+ * into a state matching target. presses receives the button numbers, returns the number
+ * of presses, 0 if current already matches and -1 if the target cannot be reached.
+ */
+int venta_plan(const venta_state_t *current, const venta_state_t *target, uint8_t *presses, int max_presses) {
+  int queue[VENTA_STATES];
+  int prev[VENTA_STATES];
+  int8_t prev_button[VENTA_STATES];
+  int head = 0, tail = 0;
+
+  pthread_once(&transitions_once, build_transitions);
+
+  if (!venta_state_valid(current)) {
+    return -1;
+  }
+  if (venta_state_matches(current, target)) {
+    return 0;
+  }
+
+  for (int i = 0; i < VENTA_STATES; i++) {
+    prev[i] = -2;
+  }
+
+  int start = state_index(current);
+  prev[start] = -1;
+  queue[tail++] = start;
+
+  while (head < tail) {
+    int s = queue[head++];
+
+    for (int b = 0; b < VENTA_BUTTONS; b++) {
+      int n = transitions[s][b];
+      if (prev[n] != -2) {
+        continue;
+      }
+      prev[n] = s;
+      prev_button[n] = b;
+
+      venta_state_t state = state_from_index(n);
+      if (venta_state_matches(&state, target)) {
+        int len = 0;
+        for (int i = n; prev[i] >= 0; i = prev[i]) {
+          len++;
+        }
+        if (len > max_presses) {
+          return -1;
+        }
+        int pos = len;
+        for (int i = n; prev[i] >= 0; i = prev[i]) {
+          presses[--pos] = buttons[prev_button[i]].btn;
+        }
+        return len;
+      }
+      queue[tail++] = n;
+    }
+  }
+
+  return -1;
+}
+
+int venta_press_button(venta_vdcd_t *dev, int btn) {
+  const venta_button_t *button = NULL;
+
+  for (int b = 0; b < VENTA_BUTTONS; b++) {
+    if (buttons[b].btn == btn) {
+      button = &buttons[b];
+      break;
+    }
+  }
+  if (button == NULL) {
+    vdc_report(LOG_ERR, "network: unknown Venta Humifier button %d\n", btn);
+    return VENTA_CONFIGCHANGE_FAILED;
+  }
+
+  vdc_report(LOG_NOTICE, "network: pressing Venta Humifier button %d\n", btn);
+
+  struct memory_struct *response = g_venta_io->request(dev, "/api/btn", button->body);
+  if (response == NULL) {
+    vdc_report(LOG_ERR, "Venta config change failed\n");
+    return VENTA_CONFIGCHANGE_FAILED;
+  }
+
+  free(response->memory);
+  free(response);
+  return VENTA_OK;
+}
+
+/* the cached state is shared with the poll, both accessors take g_network_mutex */
+int venta_get_cached_state(venta_vdcd_t *dev, venta_state_t *state) {
+  pthread_mutex_lock(&g_network_mutex);
+  state->fan = dev->current_values.fan;
+  state->mode_sleep = dev->current_values.mode_sleep;
+  state->mode_automatic = dev->current_values.mode_automatic;
+  pthread_mutex_unlock(&g_network_mutex);
+
+  return venta_state_valid(state) ? VENTA_OK : VENTA_GETMEASURE_FAILED;
+}
+
+void venta_set_cached_state(venta_vdcd_t *dev, const venta_state_t *state) {
+  pthread_mutex_lock(&g_network_mutex);
+  dev->current_values.fan = state->fan;
+  dev->current_values.mode_sleep = state->mode_sleep;
+  dev->current_values.mode_automatic = state->mode_automatic;
+  pthread_mutex_unlock(&g_network_mutex);
+}
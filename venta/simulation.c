@@ -0,0 +1,773 @@
+/*
+ Author: Alexander Knauer <a-x-e@gmx.net>
+ License: Apache 2.0
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include <json.h>
+#include <utlist.h>
+
+#include <digitalSTROM/dsuid.h>
+#include <dsvdc/dsvdc.h>
+
+#include "venta.h"
+
+/*
+ * Simulation mode: the clock is virtual and the humifier is a scripted in-process model
+ * behind the device I/O interface. Scheduler, poller, parser and push path run unmodified
+ * and write a trace of polls, pushes and commands to stdout.
+ *
+ * Script format, one event per line, times in seconds from simulation start:
+ *   <time> hum <value>      humidity keypoint, linearly interpolated
+ *   <time> temp <value>     temperature keypoint, linearly interpolated
+ *   <time> humt <value>     target humidity from this time on
+ *   <time> scene <dsId>     call a digitalSTROM scene
+ *   <time> drop <n>         the device acknowledges but ignores the next n button presses
+ *   <time> save <dsId>      save the current device state as digitalSTROM scene
+ *   <time> stall <seconds>  dSS refuses pushes for the given time
+ * Lines starting with # are comments.
+ */
+
+#define SIM_START 1000                /* virtual start time, 0 is used as "never" for sensor timestamps */
+#define SIM_MAX_EVENTS 4096
+
+typedef enum {
+  SIM_HUM,
+  SIM_TEMP,
+  SIM_HUMT,
+  SIM_SCENE,
+  SIM_DROP,
+  SIM_SAVE,
+  SIM_STALL
+} sim_event_type_t;
+
+typedef struct sim_event {
+  vdc_time_t t;
+  sim_event_type_t type;
+  double value;
+} sim_event_t;
+
+static sim_event_t events[SIM_MAX_EVENTS];
+static size_t n_events = 0;
+
+/* device model, attached to the device as io_data */
+typedef struct sim_model {
+  venta_state_t state;
+  int target_humidity;
+  int latency_ms;                       /* real time delay per request, used by the fan-out benchmark */
+  int drop;                             /* number of button presses to lose */
+} sim_model_t;
+
+static sim_model_t default_model = { { 1, 0, 0 }, 50, 0, 0 };
+
+static unsigned long sim_polls = 0;
+static unsigned long sim_pushes = 0;
+static unsigned long sim_values = 0;
+static unsigned long sim_commands = 0;
+static vdc_time_t sim_stall_until = 0;        /* pushes are refused until this time */
+
+bool g_simulation = false;
+
+static double sim_seconds(vdc_time_t t) {
+  return (t - SIM_START) / 1000.0;
+}
+
+static int add_event(vdc_time_t t, sim_event_type_t type, double value) {
+  if (n_events >= SIM_MAX_EVENTS) {
+    vdc_report(LOG_ERR, "simulation: too many events, maximum is %d\n", SIM_MAX_EVENTS);
+    return -1;
+  }
+  events[n_events].t = t;
+  events[n_events].type = type;
+  events[n_events].value = value;
+  n_events++;
+  return 0;
+}
+
+static int compare_events(const void *a, const void *b) {
+  const sim_event_t *ea = a;
+  const sim_event_t *eb = b;
+  return (ea->t > eb->t) - (ea->t < eb->t);
+}
+
+static int load_script(const char *script) {
+  FILE *f = fopen(script, "r");
+  if (f == NULL) {
+    vdc_report(LOG_ERR, "simulation: could not open script %s\n", script);
+    return -1;
+  }
+
+  char line[256];
+  int lineno = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    double t, value;
+    char key[32];
+
+    lineno++;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    if (sscanf(line, "%lf %31s %lf", &t, key, &value) != 3) {
+      vdc_report(LOG_ERR, "simulation: syntax error in %s line %d\n", script, lineno);
+      fclose(f);
+      return -1;
+    }
+
+    sim_event_type_t type;
+    if (strcmp(key, "hum") == 0) {
+      type = SIM_HUM;
+    } else if (strcmp(key, "temp") == 0) {
+      type = SIM_TEMP;
+    } else if (strcmp(key, "humt") == 0) {
+      type = SIM_HUMT;
+    } else if (strcmp(key, "scene") == 0) {
+      type = SIM_SCENE;
+    } else if (strcmp(key, "drop") == 0) {
+      type = SIM_DROP;
+    } else if (strcmp(key, "save") == 0) {
+      type = SIM_SAVE;
+    } else if (strcmp(key, "stall") == 0) {
+      type = SIM_STALL;
+    } else {
+      vdc_report(LOG_ERR, "simulation: unknown event %s in %s line %d\n", key, script, lineno);
+      fclose(f);
+      return -1;
+    }
+    if (add_event(SIM_START + (vdc_time_t) (t * 1000), type, value) < 0) {
+      fclose(f);
+      return -1;
+    }
+  }
+  fclose(f);
+
+  qsort(events, n_events, sizeof(sim_event_t), compare_events);
+  return 0;
+}
+
+/* default profile: one day of humidity and temperature following a sine wave, hourly keypoints */
+static void load_default_profile(vdc_time_t duration) {
+  for (vdc_time_t t = 0; t <= duration + 3600 * 1000; t += 3600 * 1000) {
+    double phase = 2 * M_PI * (t % (24 * 3600 * 1000)) / (24.0 * 3600 * 1000);
+    add_event(SIM_START + t, SIM_HUM, 45 + 8 * sin(phase));
+    add_event(SIM_START + t, SIM_TEMP, 21 + 2 * sin(phase - M_PI / 4));
+  }
+  qsort(events, n_events, sizeof(sim_event_t), compare_events);
+}
+
+/* linear interpolation between the keypoints of one profile */
+static double profile_value(sim_event_type_t type, vdc_time_t now, double fallback) {
+  const sim_event_t *prev = NULL;
+  const sim_event_t *next = NULL;
+
+  for (size_t i = 0; i < n_events; i++) {
+    if (events[i].type != type) {
+      continue;
+    }
+    if (events[i].t <= now) {
+      prev = &events[i];
+    } else {
+      next = &events[i];
+      break;
+    }
+  }
+
+  if (prev == NULL && next == NULL) {
+    return fallback;
+  } else if (prev == NULL) {
+    return next->value;
+  } else if (next == NULL || type == SIM_HUMT) {
+    return prev->value;
+  }
+  return prev->value + (next->value - prev->value) * (now - prev->t) / (double) (next->t - prev->t);
+}
+
+static struct memory_struct* sim_response(const char *data) {
+  struct memory_struct *chunk = malloc(sizeof(struct memory_struct));
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->memory = strdup(data);
+  chunk->size = strlen(data);
+  return chunk;
+}
+
+static struct memory_struct* sim_request(venta_vdcd_t *dev, const char *path, const char *body) {
+  sim_model_t *model = dev->io_data;
+  vdc_time_t now = vdc_clock_ms();
+  char data[256];
+
+  if (model->latency_ms > 0) {
+    struct timespec delay = { model->latency_ms / 1000, (model->latency_ms % 1000) * 1000000 };
+    nanosleep(&delay, NULL);
+  }
+
+  if (strcmp(path, "/api/data") == 0) {
+    int hum = (int) lround(profile_value(SIM_HUM, now, 45));
+    int temp = (int) lround(profile_value(SIM_TEMP, now, 21));
+    model->target_humidity = (int) lround(profile_value(SIM_HUMT, now, model->target_humidity));
+
+    snprintf(data, sizeof(data), "{\"device\":{\"hum\":%d,\"temp\":%d,\"humt\":%d,\"fan\":%d,\"sleep\":%d,\"auto\":%d}}",
+        hum, temp, model->target_humidity, model->state.fan, model->state.mode_sleep, model->state.mode_automatic);
+    __sync_fetch_and_add(&sim_polls, 1);
+    printf("%10.3f poll hum=%d temp=%d humt=%d fan=%d sleep=%d auto=%d\n", sim_seconds(now),
+        hum, temp, model->target_humidity, model->state.fan, model->state.mode_sleep, model->state.mode_automatic);
+    return sim_response(data);
+  }
+
+  if (strcmp(path, "/api/btn") == 0 && body != NULL) {
+    json_object *jobj = json_tokener_parse(body);
+    json_object *jbtn;
+    int btn = -1;
+    if (jobj != NULL && json_object_object_get_ex(jobj, "btn", &jbtn)) {
+      btn = json_object_get_int(jbtn);
+    }
+    if (jobj != NULL) {
+      json_object_put(jobj);
+    }
+
+    __sync_fetch_and_add(&sim_commands, 1);
+    if (model->drop > 0) {
+      model->drop--;
+      printf("%10.3f cmd btn=%d lost\n", sim_seconds(now), btn);
+      return sim_response("{}");
+    }
+    venta_button_apply(btn, &model->state);
+    printf("%10.3f cmd btn=%d fan=%d sleep=%d auto=%d\n", sim_seconds(now),
+        btn, model->state.fan, model->state.mode_sleep, model->state.mode_automatic);
+    return sim_response("{}");
+  }
+
+  vdc_report(LOG_WARNING, "simulation: unhandled request %s\n", path);
+  return NULL;
+}
+
+static const venta_io_t sim_io = {
+  .name = "simulation",
+  .request = sim_request
+};
+
+/* the simulated dSS asks for the sensor values of a device, as it does after the announcement */
+static void sim_query_sensors(venta_vdcd_t *dev) {
+  dsvdc_property_t *query, *reply;
+
+  if (dsvdc_property_new(&query) != DSVDC_OK) {
+    return;
+  }
+  if (dsvdc_property_new(&reply) == DSVDC_OK) {
+    dsvdc_property_add_bool(query, "sensorStates", false);
+    venta_get_device_properties(dev, reply, query);
+    dsvdc_property_free(reply);
+  }
+  dsvdc_property_free(query);
+}
+
+/* trace a push instead of sending it, returns VENTA_CONNECT_FAILED while dSS stalls */
+int simulation_trace_push(venta_vdcd_t *dev, uint32_t sensors) {
+  vdc_time_t now = vdc_clock_ms();
+
+  if (now < sim_stall_until) {
+    printf("%10.3f push refused\n", sim_seconds(now));
+    return VENTA_CONNECT_FAILED;
+  }
+
+  sim_pushes++;
+  printf("%10.3f push%s", sim_seconds(now), dev->tentative ? " tentative" : "");
+  for (int i = 0; i < dev->n_sensors; i++) {
+    if (sensors & (1u << i)) {
+      printf(" %s=%g", dev->sensor_config[i].value_name, dev->sensors[i].value);
+      sim_values++;
+    }
+  }
+  printf("\n");
+  return VENTA_OK;
+}
+
+int simulation_run(const char *script, vdc_time_t duration) {
+  struct timespec t0, t1;
+
+  if (script != NULL) {
+    if (load_script(script) < 0) {
+      return -1;
+    }
+  } else {
+    load_default_profile(duration);
+  }
+
+  // the script drives the first device, further configured devices follow the same model
+  venta_vdcd_t *dev;
+  g_venta_io = &sim_io;
+  LL_FOREACH(humifier_device, dev) {
+    dev->io_data = &default_model;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  vdc_time_t now = SIM_START;
+  vdc_time_t end = SIM_START + duration;
+  size_t ev = 0;
+
+  // startup times are measured from the start of the simulation
+  g_process_start = SIM_START;
+
+  char *dsuid = humifier_device->dsuidstring;
+
+  while (now <= end && !g_shutdown_flag) {
+    vdc_clock_set_virtual(now);
+
+    for (; ev < n_events && events[ev].t <= now; ev++) {
+      if (events[ev].type == SIM_SCENE) {
+        printf("%10.3f scene %d\n", sim_seconds(now), (int) events[ev].value);
+        vdc_callscene_cb(NULL, &dsuid, 1, (int32_t) events[ev].value, false, NULL, NULL, NULL);
+      } else if (events[ev].type == SIM_DROP) {
+        default_model.drop += (int) events[ev].value;
+      } else if (events[ev].type == SIM_SAVE) {
+        printf("%10.3f save %d\n", sim_seconds(now), (int) events[ev].value);
+        vdc_savescene_cb(NULL, &dsuid, 1, (int32_t) events[ev].value, NULL, NULL, NULL);
+      } else if (events[ev].type == SIM_STALL) {
+        printf("%10.3f stall %g s\n", sim_seconds(now), events[ev].value);
+        sim_stall_until = now + (vdc_time_t) (events[ev].value * 1000);
+      }
+    }
+    venta_config_flush(false);
+    LL_FOREACH(humifier_device, dev) {
+      venta_commands_process(dev);
+    }
+
+    vdc_time_t next = venta_poll_step(now);
+    if (g_first_valid_reply == 0) {
+      // dSS repeats its query every second until it gets values
+      sim_query_sensors(humifier_device);
+      if (g_first_valid_reply == 0 && now + 1000 < next) {
+        next = now + 1000;
+      }
+    }
+    LL_FOREACH(humifier_device, dev) {
+      vdc_time_t next_push;
+      venta_outbox_put(dev, venta_sensors_due(dev, now, VENTA_PUSH_SCHEDULED, &next_push));
+      venta_outbox_drain(dev);
+      if (next_push < next) {
+        next = next_push;
+      }
+      if (venta_outbox_depth(dev) > 0 && dev->outbox.retry_at < next) {
+        next = dev->outbox.retry_at;
+      }
+      if (!venta_commands_idle(dev)) {
+        // retry queued by the verification poll
+        next = now;
+      }
+    }
+
+    /* advance to the next poll deadline or the next scripted device event */
+    for (size_t i = ev; i < n_events; i++) {
+      if (events[i].type != SIM_HUM && events[i].type != SIM_TEMP && events[i].type != SIM_HUMT) {
+        if (events[i].t < next) {
+          next = events[i].t;
+        }
+        break;
+      }
+    }
+    now = (next > now) ? next : now + 1;
+  }
+
+  venta_config_flush(true);
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  printf("# simulated %.0f s in %.3f s: %lu polls, %lu pushes with %lu sensor values, %lu commands\n",
+      duration / 1000.0, elapsed, sim_polls, sim_pushes, sim_values, sim_commands);
+  printf("# startup: first poll after %.3f s, first valid sensorStates reply after %.3f s\n",
+      g_first_poll_time ? sim_seconds(g_first_poll_time) : -1.0, g_first_valid_reply ? sim_seconds(g_first_valid_reply) : -1.0);
+  unsigned long attempts = sim_pushes + humifier_device->outbox.failed;
+  printf("# %lu property allocations for pushes, %.1f per push attempt\n", g_push_allocations,
+      attempts ? (double) g_push_allocations / attempts : 0.0);
+  printf("# outbox: %lu queued, %lu coalesced, %lu sent, %lu failed pushes, %lu dropped, max depth %d\n",
+      humifier_device->outbox.enqueued, humifier_device->outbox.coalesced, humifier_device->outbox.sent,
+      humifier_device->outbox.failed, humifier_device->outbox.dropped, humifier_device->outbox.depth_max);
+  printf("# %lu scene commands, %lu coalesced, %lu presses saved, %lu confirmed, %lu rolled back\n", humifier_device->commands.submitted,
+      humifier_device->commands.coalesced, humifier_device->commands.presses_saved,
+      humifier_device->commands.confirmed, humifier_device->commands.rolled_back);
+  for (int i = 0; i < humifier_device->commands.n_stats; i++) {
+    venta_scene_stats_t *stats = &humifier_device->commands.stats[i];
+    if (stats->calls > 0) {
+      printf("# scene %d: %lu calls, %lu settled, %lu failed, %lu superseded, %lu retries, settle max %.3f s\n",
+          (stats->scene < DS_SCENES) ? stats->scene : -1, stats->calls, stats->settled, stats->failed, stats->superseded, stats->retries, stats->settle_max / 1000.0);
+    }
+  }
+  return 0;
+}
+
+/*
+ * Fan-out benchmark: n_devices simulated humifiers with a fixed request latency receive one
+ * zone scene call. The wall clock time until all devices settled is compared with the time
+ * serial execution of all presses would take.
+ */
+int simulation_bench_fanout(int n_devices, int latency_ms) {
+  venta_vdcd_t **devices = calloc(n_devices, sizeof(venta_vdcd_t *));
+  sim_model_t *models = calloc(n_devices, sizeof(sim_model_t));
+  char **dsuids = calloc(n_devices, sizeof(char *));
+  int scene = -1;
+  struct timespec t0, t1;
+
+  if (devices == NULL || models == NULL || dsuids == NULL) {
+    free(devices);
+    free(models);
+    free(dsuids);
+    return VENTA_OUT_OF_MEMORY;
+  }
+
+  for (int s = 0; s < DS_SCENES; s++) {
+    if (is_scene_configured(humifier_device->humifier, s)) {
+      scene = s;
+      break;
+    }
+  }
+  if (scene < 0) {
+    vdc_report(LOG_ERR, "benchmark: no scene configured\n");
+    free(devices);
+    free(models);
+    free(dsuids);
+    return -1;
+  }
+
+  g_venta_io = &sim_io;
+  venta_vdcd_t *list = NULL;
+  for (int i = 0; i < n_devices; i++) {
+    venta_vdcd_t *dev = venta_device_new(humifier_device->humifier, humifier_device->sensor_config, humifier_device->n_sensors);
+    if (dev == NULL) {
+      n_devices = i;
+      break;
+    }
+    // every device has its own sensors, command threads write tentative values into them
+    memcpy(dev->sensors, humifier_device->sensors, humifier_device->n_sensors * sizeof(sensor_value_t));
+    snprintf(dev->dsuidstring, sizeof(dev->dsuidstring), "%032X%02X", i, 0);
+
+    // every device starts from the state most distant from the scene target
+    models[i].state = (venta_state_t) { VENTA_FAN_MAX, 0, 1 };
+    models[i].latency_ms = latency_ms;
+    dev->io_data = &models[i];
+    dev->current_values.fan = models[i].state.fan;
+    dev->current_values.mode_sleep = models[i].state.mode_sleep;
+    dev->current_values.mode_automatic = models[i].state.mode_automatic;
+
+    devices[i] = dev;
+    LL_APPEND(list, dev);
+    dsuids[i] = dev->dsuidstring;
+  }
+
+  venta_vdcd_t *saved_device = humifier_device;
+  humifier_device = list;
+  venta_registry_build();
+  venta_commands_start();
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  vdc_callscene_cb(NULL, dsuids, n_devices, scene, false, NULL, NULL, NULL);
+  for (int i = 0; i < n_devices; i++) {
+    while (!venta_commands_idle(devices[i])) {
+      struct timespec delay = { 0, 1000000 };
+      nanosleep(&delay, NULL);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  venta_commands_stop();
+  unsigned long presses = 0;
+  for (int i = 0; i < n_devices; i++) {
+    presses += devices[i]->commands.presses;
+  }
+  humifier_device = saved_device;
+  venta_registry_build();
+
+  double elapsed = (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+  printf("# fan-out of scene %d to %d devices with %d workers: %lu presses at %d ms latency, %.1f ms wall clock, %lu ms serial\n",
+      scene, n_devices, VENTA_COMMAND_WORKERS, presses, latency_ms, elapsed, presses * latency_ms);
+
+  for (int i = 0; i < n_devices; i++) {
+    venta_commands_destroy(devices[i]);
+    free(devices[i]->sensors);
+    free(devices[i]);
+  }
+  free(devices);
+  free(models);
+  free(dsuids);
+  return 0;
+}
+
+/*
+ * Dimming benchmark: a 2 second dimming gesture on the fan level channel sends one channel
+ * value every 50 ms to a simulated humifier with a fixed request latency. Reports how many
+ * commands and button presses reached the device.
+ */
+int simulation_bench_dimming(int latency_ms) {
+  venta_vdcd_t *dev = humifier_device;
+  sim_model_t model = { { VENTA_FAN_MIN, 0, 0 }, 40, latency_ms, 0 };
+  struct timespec t0, t1;
+  char *dsuid = dev->dsuidstring;
+
+  g_venta_io = &sim_io;
+  dev->io_data = &model;
+  dev->current_values.fan = model.state.fan;
+  dev->current_values.mode_sleep = model.state.mode_sleep;
+  dev->current_values.mode_automatic = model.state.mode_automatic;
+  venta_commands_start();
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int step = 0; step <= 40; step++) {
+    double fan = VENTA_FAN_MIN + (VENTA_FAN_MAX - VENTA_FAN_MIN) * step / 40.0;
+    vdc_output_channel_value_cb(NULL, &dsuid, 1, true, VENTA_CHANNEL_TYPE_FAN, fan, NULL, NULL, NULL);
+    struct timespec delay = { 0, 50 * 1000000 };
+    nanosleep(&delay, NULL);
+  }
+  while (!venta_commands_idle(dev)) {
+    struct timespec delay = { 0, 1000000 };
+    nanosleep(&delay, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  venta_commands_stop();
+
+  double elapsed = (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+  printf("# dimming fan %d -> %d: 41 channel values, %lu commands, %lu coalesced, %lu presses, final fan=%d, %.1f ms at %d ms latency\n",
+      VENTA_FAN_MIN, VENTA_FAN_MAX, dev->commands.submitted, dev->commands.coalesced, dev->commands.presses,
+      model.state.fan, elapsed, latency_ms);
+  return 0;
+}
+
+/* canned poll response for the getprop benchmark, without the trace output of sim_request */
+static struct memory_struct* bench_request(venta_vdcd_t *dev __attribute__((unused)), const char *path __attribute__((unused)), const char *body __attribute__((unused))) {
+  return sim_response("{\"device\":{\"hum\":44,\"temp\":21,\"humt\":50,\"fan\":2,\"sleep\":0,\"auto\":1}}");
+}
+
+static const venta_io_t bench_io = {
+  .name = "benchmark",
+  .request = bench_request
+};
+
+static volatile int bench_poll_stop;
+static long bench_polls, bench_polls_blocked;
+static double bench_poll_wait_us;
+
+static double bench_elapsed_us(const struct timespec *t0, const struct timespec *t1) {
+  return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+/* polls as the network thread does, counting the polls that found g_network_mutex taken */
+static void* bench_poll_thread(void *arg) {
+  venta_vdcd_t *dev = arg;
+  struct timespec t0, t1;
+
+  bench_polls = bench_polls_blocked = 0;
+  bench_poll_wait_us = 0;
+  while (!bench_poll_stop) {
+    if (pthread_mutex_trylock(&g_network_mutex) != 0) {
+      bench_polls_blocked++;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      pthread_mutex_lock(&g_network_mutex);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      bench_poll_wait_us += bench_elapsed_us(&t0, &t1);
+    }
+    pthread_mutex_unlock(&g_network_mutex);
+    venta_get_data(dev);
+    bench_polls++;
+  }
+  return NULL;
+}
+
+static size_t bench_queries(venta_vdcd_t *dev, const dsvdc_property_t *query, int queries, double *us) {
+  struct timespec t0, t1;
+  size_t answers = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int q = 0; q < queries; q++) {
+    dsvdc_property_t *reply;
+    if (dsvdc_property_new(&reply) != DSVDC_OK) {
+      break;
+    }
+    venta_get_device_properties(dev, reply, query);
+    answers = dsvdc_property_get_num_properties(reply);
+    dsvdc_property_free(reply);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  *us = bench_elapsed_us(&t0, &t1) / queries;
+  return answers;
+}
+
+/*
+ * getprop benchmark: answers the property query dSS sends when a device is added, all vDSD
+ * properties including the live channel and sensor states, queries times in a row. The
+ * queries are then repeated with a poll thread running against them, as the network thread
+ * does against libdsvdc. Reports the time per query of both runs and how often and how long
+ * a poll had to wait for g_network_mutex.
+ */
+int simulation_bench_getprop(int queries) {
+  static const char *names[] = {
+    "primaryGroup", "zoneID", "buttonInputDescriptions", "buttonInputSettings",
+    "dynamicActionDescriptions", "outputDescription", "outputSettings", "channelDescriptions",
+    "channelSettings", "channelStates", "sensorDescriptions", "sensorSettings", "sensorStates",
+    "name", "type", "model", "modelFeatures", "modelUID", "modelVersion", "vendorId", "vendorName",
+    "vendorGuid", "hardwareVersion", "configURL", "hardwareModelGuid", "deviceIcon16", "deviceIcon48",
+    "deviceIconName"
+  };
+  venta_vdcd_t *dev = humifier_device;
+  dsvdc_property_t *query;
+  pthread_t poller;
+  double query_us, concurrent_us;
+
+  if (dsvdc_property_new(&query) != DSVDC_OK) {
+    return -1;
+  }
+  for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+    dsvdc_property_add_bool(query, names[n], false);
+  }
+  g_venta_io = &bench_io;
+
+  size_t answers = bench_queries(dev, query, queries, &query_us);
+
+  bench_poll_stop = 0;
+  pthread_create(&poller, NULL, bench_poll_thread, dev);
+  bench_queries(dev, query, queries, &concurrent_us);
+  bench_poll_stop = 1;
+  pthread_join(poller, NULL);
+  dsvdc_property_free(query);
+
+  printf("# getprop: %d queries of %zu names, %zu answers per reply, %.2f us per query, %.2f us with a concurrent poll thread\n",
+      queries, sizeof(names) / sizeof(names[0]), answers, query_us, concurrent_us);
+  printf("# getprop: %ld polls, %ld (%.3f%%) waited for the network lock, %.2f us average wait\n",
+      bench_polls, bench_polls_blocked, bench_polls ? 100.0 * bench_polls_blocked / bench_polls : 0.0,
+      bench_polls_blocked ? bench_poll_wait_us / bench_polls_blocked : 0.0);
+  return 0;
+}
+
+/* one device of the synthetic configuration, all scene numbers in use */
+static void bench_config_device(FILE *f, int i) {
+  fprintf(f, "{\n  id = \"bench%04d\";\n  name = \"Bench %d\";\n  ip = \"10.0.%d.%d\";\n  scenes = {\n", i, i, i / 250, i % 250 + 1);
+  for (int s = 0; s < MAX_SCENES; s++) {
+    fprintf(f, "    s%d = { dsId = %d; fan = %d; mode_sleep = %d; };\n", s, s, s % VENTA_FAN_MAX + VENTA_FAN_MIN, s & 1);
+  }
+  fprintf(f, "  };\n  sensor_values = {\n"
+      "    s0 = { value_name = \"temp\"; sensor_type = 1; sensor_usage = 1; };\n"
+      "    s1 = { value_name = \"hum\"; sensor_type = 2; sensor_usage = 1; deadband = 1.0; };\n"
+      "    s2 = { value_name = \"humt\"; sensor_type = 2; sensor_usage = 1; };\n"
+      "  };\n}");
+}
+
+/* load the file rounds times, returns the best time in ms */
+static double bench_config_load(const char *path, int rounds, int *devices) {
+  const char *saved_cfgfile = g_cfgfile;
+  double best = 0;
+
+  g_cfgfile = path;
+  for (int r = 0; r < rounds; r++) {
+    struct timespec t0, t1;
+    venta_vdcd_t *dev;
+
+    humifier_device = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int rc = read_config();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (rc != 0) {
+      best = -1;
+      break;
+    }
+    double ms = bench_elapsed_us(&t0, &t1) / 1000.0;
+    if (r == 0 || ms < best) {
+      best = ms;
+    }
+    *devices = 0;
+    LL_FOREACH(humifier_device, dev) {
+      (*devices)++;
+    }
+  }
+  g_cfgfile = saved_cfgfile;
+  return best;
+}
+
+/*
+ * Load a synthetic configuration of n_devices with MAX_SCENES scenes each, once as one file
+ * with the humifiers list and once with every device in its own @include file.
+ */
+int simulation_bench_config(int n_devices) {
+  char dir[] = "/tmp/venta-bench-XXXXXX";
+  char path[PATH_MAX];
+  int devices = 0, included = 0;
+  int rc = 0;
+
+  if (mkdtemp(dir) == NULL) {
+    vdc_report(LOG_ERR, "bench: cannot create a temporary directory\n");
+    return -1;
+  }
+
+  snprintf(path, sizeof(path), "%s/list.cfg", dir);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    rmdir(dir);
+    return -1;
+  }
+  fprintf(f, "vdcdsuid = \"bench\";\nhumifiers = (\n");
+  for (int i = 0; i < n_devices; i++) {
+    bench_config_device(f, i);
+    fprintf(f, "%s\n", i + 1 < n_devices ? "," : "");
+  }
+  fprintf(f, ");\n");
+  fclose(f);
+
+  snprintf(path, sizeof(path), "%s/include.cfg", dir);
+  f = fopen(path, "w");
+  if (f == NULL) {
+    rc = -1;
+  } else {
+    fprintf(f, "vdcdsuid = \"bench\";\nhumifiers = {\n");
+    for (int i = 0; i < n_devices && rc == 0; i++) {
+      char devpath[PATH_MAX];
+      snprintf(devpath, sizeof(devpath), "%s/bench%04d.cfg", dir, i);
+      FILE *d = fopen(devpath, "w");
+      if (d == NULL) {
+        rc = -1;
+        break;
+      }
+      fprintf(d, "bench%04d = ", i);
+      bench_config_device(d, i);
+      fprintf(d, ";\n");
+      fclose(d);
+      fprintf(f, "@include \"bench%04d.cfg\"\n", i);
+    }
+    fprintf(f, "};\n");
+    fclose(f);
+  }
+
+  if (rc == 0) {
+    snprintf(path, sizeof(path), "%s/list.cfg", dir);
+    double list_ms = bench_config_load(path, 5, &devices);
+    snprintf(path, sizeof(path), "%s/include.cfg", dir);
+    double include_ms = bench_config_load(path, 5, &included);
+
+    if (list_ms < 0 || include_ms < 0) {
+      rc = -1;
+    } else {
+      printf("# config: %d devices with %d scenes, one file %.1f ms (%.1f us per device, %d loaded)\n",
+          n_devices, MAX_SCENES, list_ms, list_ms * 1000 / n_devices, devices);
+      printf("# config: %d devices in @include files %.1f ms (%.1f us per device, %d loaded)\n",
+          n_devices, include_ms, include_ms * 1000 / n_devices, included);
+    }
+  }
+
+  for (int i = 0; i < n_devices; i++) {
+    snprintf(path, sizeof(path), "%s/bench%04d.cfg", dir, i);
+    unlink(path);
+  }
+  snprintf(path, sizeof(path), "%s/list.cfg", dir);
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/include.cfg", dir);
+  unlink(path);
+  rmdir(dir);
+  return rc;
+}
@@ -11,6 +11,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <time.h>
 #include <string.h>
 #include <pthread.h>
 #include <inttypes.h>
@@ -21,14 +22,45 @@
 
 
 static pthread_mutex_t reportMutex;
+static bool virtualClock = false;
+static vdc_time_t virtualNow = 0;
 static int debugLevel = LOG_WARNING;
 static void printMessage(char *buf);
 
-static double get_timestamp(void) {
-  struct timeval tv;
+/* monotonic millisecond clock, used for all deadlines, sensor ages and latencies */
+vdc_time_t vdc_clock_ms(void) {
+  struct timespec ts;
 
-  gettimeofday(&tv, NULL);
-  return (tv.tv_sec + tv.tv_usec*1e-6);
+  if (virtualClock) {
+    return virtualNow;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (vdc_time_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* switch to virtual time for the simulation mode, time only advances by calling this function */
+void vdc_clock_set_virtual(vdc_time_t ms) {
+  virtualClock = true;
+  virtualNow = ms;
+}
+
+/* absolute timespec of a monotonic timestamp, for pthread_cond_timedwait on a CLOCK_MONOTONIC condition */
+void vdc_clock_timespec(vdc_time_t ms, struct timespec *ts) {
+  ts->tv_sec = ms / 1000;
+  ts->tv_nsec = (ms % 1000) * 1000000;
+}
+
+/* wall clock representation of a monotonic timestamp, only meant for log output */
+char* vdc_clock_format(vdc_time_t ms, char *buf, size_t len) {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+
+  int64_t wall = (int64_t) t.tv_sec * 1000 + t.tv_usec / 1000 + (ms - vdc_clock_ms());
+  time_t sec = wall / 1000;
+  char tsbuf[30];
+  strftime(tsbuf, sizeof(tsbuf), "%Y-%m-%d %H:%M:%S", localtime(&sec));
+  snprintf(buf, len, "%s.%03d", tsbuf, (int) (wall % 1000));
+  return buf;
 }
 
 void vdc_init_report() {
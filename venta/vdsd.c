@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <math.h>
 
 #include <libconfig.h>
 #include <curl/curl.h>
@@ -31,37 +32,137 @@ INCBIN_EXTERN(VentaHumifier48);
 
 void vdc_ping_cb(dsvdc_t *handle __attribute__((unused)), const char *dsuid, void *userdata __attribute__((unused))) {
   int ret;
+  venta_vdcd_t *dev;
+
   vdc_report(LOG_NOTICE, "received ping for dsuid %s\n", dsuid);
-  if (strcasecmp(dsuid, g_vdc_dsuid) == 0) {
-    ret = dsvdc_send_pong(handle, dsuid);
-    vdc_report(LOG_NOTICE, "sent pong for vdc %s / return code %d\n", dsuid, ret);
+  switch (venta_registry_lookup(dsuid, &dev)) {
+    case VENTA_TARGET_VDC:
+      ret = dsvdc_send_pong(handle, dsuid);
+      vdc_report(LOG_NOTICE, "sent pong for vdc %s / return code %d\n", dsuid, ret);
+      break;
+    case VENTA_TARGET_LIB:
+      ret = dsvdc_send_pong(handle, dsuid);
+      vdc_report(LOG_NOTICE, "sent pong for lib-dsuid %s / return code %d\n", dsuid, ret);
+      break;
+    case VENTA_TARGET_DEVICE:
+      ret = dsvdc_send_pong(handle, dev->dsuidstring);
+      vdc_report(LOG_NOTICE, "sent pong for device %s / return code %d\n", dsuid, ret);
+      break;
+    default:
+      vdc_report(LOG_WARNING, "ping: no matching dsuid %s registered\n", dsuid);
+  }
+}
+
+/*
+ * Session bring-up: the container is announced on a new session, its completion callback
+ * announces all devices in one burst, and each device completion identifies the device and
+ * queues its initial values. Failed announcements are retried by the main loop.
+ */
+
+static vdc_time_t session_start = 0;
+static bool container_announced = false;
+
+/* announce all present devices that are not announced yet, called with g_network_mutex held */
+void venta_announce_devices(dsvdc_t *handle) {
+  venta_vdcd_t *dev;
+  int n = 0;
+
+  if (!container_announced) {
     return;
   }
-  if (strcasecmp(dsuid, g_lib_dsuid) == 0) {
-    ret = dsvdc_send_pong(handle, dsuid);
-    vdc_report(LOG_NOTICE, "sent pong for lib-dsuid %s / return code %d\n", dsuid, ret);
+
+  LL_FOREACH(humifier_device, dev) {
+    if (dev->bringup != VENTA_BRINGUP_IDLE || !dev->present) {
+      continue;
+    }
+    int ret = dsvdc_announce_device(handle, g_vdc_dsuid, dev->dsuidstring, dev, vdc_announce_device_cb);
+    if (ret != DSVDC_OK) {
+      vdc_report(LOG_WARNING, "announce device %s returned error %d\n", dev->dsuidstring, ret);
+      continue;
+    }
+    dev->bringup = VENTA_BRINGUP_ANNOUNCING;
+    dev->announce_sent = vdc_clock_ms();
+    n++;
+  }
+  if (n > 0) {
+    vdc_report(LOG_INFO, "session: %d device announcements sent\n", n);
+  }
+}
+
+/* the session is gone, devices are announced again on the next one */
+void venta_session_lost() {
+  venta_vdcd_t *dev;
+
+  container_announced = false;
+  LL_FOREACH(humifier_device, dev) {
+    dev->announced = false;
+    dev->presentSignaled = false;
+    dev->bringup = VENTA_BRINGUP_IDLE;
+    venta_outbox_drop(dev, "no session");
+  }
+}
+
+void vdc_announce_device_cb(dsvdc_t *handle, int code, void *arg, void *userdata __attribute__((unused))) {
+  venta_vdcd_t *dev = arg;
+  venta_vdcd_t *d;
+  vdc_time_t now = vdc_clock_ms();
+  vdc_time_t next;
+  int active = 0, total = 0;
+
+  vdc_report(LOG_INFO, "announcement of device %s returned code: %d after %lld ms\n", dev->dsuidstring, code, (long long) (now - dev->announce_sent));
+
+  pthread_mutex_lock(&g_network_mutex);
+  if (dev->bringup != VENTA_BRINGUP_ANNOUNCING) {
+    pthread_mutex_unlock(&g_network_mutex);
     return;
   }
-  
-  if (strcasecmp(dsuid, humifier_device->dsuidstring) == 0) {
-      ret = dsvdc_send_pong(handle, humifier_device->dsuidstring);
-      vdc_report(LOG_NOTICE, "sent pong for device %s / return code %d\n", dsuid, ret);
+  if (code != DSVDC_OK) {
+    dev->bringup = VENTA_BRINGUP_IDLE;
+    pthread_mutex_unlock(&g_network_mutex);
     return;
   }
-  vdc_report(LOG_WARNING, "ping: no matching dsuid %s registered\n", dsuid);
-}
 
-void vdc_announce_device_cb(dsvdc_t *handle __attribute__((unused)), int code, void *arg, void *userdata __attribute__((unused))) {
-  vdc_report(LOG_INFO, "announcement of device %s returned code: %d\n", (char *) arg, code);
+  dev->announced = true;
+  if (dev->present && dsvdc_identify_device(handle, dev->dsuidstring) == DSVDC_OK) {
+    dev->presentSignaled = true;
+  }
+  venta_outbox_put(dev, venta_sensors_due(dev, now, VENTA_PUSH_ALL, &next));
+  dev->bringup = VENTA_BRINGUP_ACTIVE;
+
+  LL_FOREACH(humifier_device, d) {
+    total++;
+    if (d->bringup == VENTA_BRINGUP_ACTIVE) {
+      active++;
+    }
+  }
+  pthread_mutex_unlock(&g_network_mutex);
+
+  if (active == total) {
+    vdc_report(LOG_NOTICE, "session: %d devices announced %lld ms after session start\n", total, (long long) (now - session_start));
+  }
 }
 
-void vdc_announce_container_cb(dsvdc_t *handle __attribute__((unused)), int code, void *arg, void *userdata __attribute__((unused))) {
+void vdc_announce_container_cb(dsvdc_t *handle, int code, void *arg, void *userdata __attribute__((unused))) {
   vdc_report(LOG_INFO, "announcement of container %s returned code: %d\n", (char *) arg, code);
+  if (code != DSVDC_OK) {
+    return;
+  }
+
+  container_announced = true;
+  pthread_mutex_lock(&g_network_mutex);
+  venta_announce_devices(handle);
+  pthread_mutex_unlock(&g_network_mutex);
 }
 
 void vdc_new_session_cb(dsvdc_t *handle, void *userdata) {
   (void)userdata;
   int ret;
+
+  session_start = vdc_clock_ms();
+  pthread_mutex_lock(&g_network_mutex);
+  venta_session_lost();
+  pthread_mutex_unlock(&g_network_mutex);
+
   ret = dsvdc_announce_container(handle,
                                  g_vdc_dsuid,
                                  (void *) g_vdc_dsuid,
@@ -71,14 +172,19 @@ void vdc_new_session_cb(dsvdc_t *handle, void *userdata) {
     return;
   }
 
-  vdc_report(LOG_INFO, "new session, container announced successfully\n");
+  vdc_report(LOG_INFO, "new session, container announcement sent\n");
+
+  /* dSS may have been restarted, fetch fresh values for the upcoming device announcement */
+  venta_request_refresh(NULL);
 }
 
 void vdc_end_session_cb(dsvdc_t *handle, void *userdata) {
   (void)userdata;
-  int ret;
 
   vdc_report(LOG_WARNING, "end of session\n");
+  pthread_mutex_lock(&g_network_mutex);
+  venta_session_lost();
+  pthread_mutex_unlock(&g_network_mutex);
 }
 
 bool vdc_remove_cb(dsvdc_t *handle __attribute__((unused)), const char *dsuid, void *userdata) {
@@ -97,7 +203,8 @@ void vdc_request_generic_cb(dsvdc_t *handle __attribute__((unused)), char *dsuid
   
   vdc_report(LOG_INFO, "received request generic for dsuid %s, method name %s\n", dsuid, method_name);
   
-  if (strcasecmp(humifier_device->dsuidstring, dsuid) == 0) {
+  venta_vdcd_t *dev = find_device_by_dsuid(dsuid);
+  if (dev != NULL) {
     for (i = 0; i < dsvdc_property_get_num_properties(properties); i++) {
       char *name;
       ret = dsvdc_property_get_name(properties, i, &name);
@@ -123,637 +230,418 @@ void vdc_request_generic_cb(dsvdc_t *handle __attribute__((unused)), char *dsuid
           break;
         }
         
-        scene_t *scene_data;
-        scene_data = malloc(sizeof(scene_t));
-        if (!scene_data) {
-          return;
-        }
-        memset(scene_data, 0, sizeof(scene_t));
-          
-        if(strcasecmp(id, "ActTurnOn") == 0) {
-          vdc_report(LOG_DEBUG, "Exec Start Cabin command");
-          //klafs_power_on();
-          
-        } else {
-          vdc_report(LOG_NOTICE, "request_generic_cb: command = %s not implemented\n", id);
-        }
+        /* only queued here, the device is not accessed on the dsvdc thread */
+        code = venta_invoke_action(dev, id);
+        free(id);
       }
+      free(name);
     }      
+  } else {
+    code = DSVDC_ERR_NOT_FOUND;
   }
+
+  dsvdc_send_generic_response(handle, property, code, NULL);
 }
 
 void vdc_savescene_cb(dsvdc_t *handle __attribute__((unused)), char **dsuid, size_t n_dsuid, int32_t scene, int32_t *group, int32_t *zone_id, void *userdata) {
-  vdc_report(LOG_NOTICE, "save scene %d\n", scene);
-  if (strcasecmp(humifier_device->dsuidstring, *dsuid) == 0) {
-    
+  vdc_report(LOG_NOTICE, "save scene %d for %d devices\n", scene, (int) n_dsuid);
+
+  /* captures the state of the last poll, the configuration file is written debounced from the main loop */
+  for (size_t i = 0; i < n_dsuid; i++) {
+    venta_vdcd_t *dev = find_device_by_dsuid(dsuid[i]);
+    if (dev == NULL) {
+      vdc_report(LOG_WARNING, "save scene: unhandled dsuid %s\n", dsuid[i]);
+      continue;
+    }
+    save_scene(dev, scene);
   }
 }
   
 void vdc_callscene_cb(dsvdc_t *handle __attribute__((unused)), char **dsuid, size_t n_dsuid, int32_t scene, bool force, int32_t *group, int32_t *zone_id, void *userdata) {
-  if (strcasecmp(humifier_device->dsuidstring, *dsuid) == 0) {
-    vdc_report(LOG_NOTICE, "called scene: %d\n", scene);
-    
-    bool is_configured = is_scene_configured(scene);
-    if(is_configured) {
-      scene_t* scene_data = get_scene_configuration(scene);
-
-      if (scene_data != NULL) {
-        int i = 0;
-        venta_get_data();
-        if (scene_data->mode_sleep > 0) {            
-          venta_set_mode_sleep(true);
-	  venta_set_fan(4);
-          venta_set_fan(4);	
-        } else if (scene_data->mode_sleep == 0) {            
-          venta_set_mode_sleep(false);
-        }
-       
-        if (scene_data->mode_automatic > 0) {
-          venta_set_mode_automatic(true);          
-        } else if (scene_data->mode_automatic == 0) {
-          venta_set_mode_automatic(false);          
-        }
-          
-        if (scene_data->fan == 1) {            
-          venta_set_fan(4);
-          venta_set_fan(4);
-        } else if (scene_data->fan == 2) {          
-          if (humifier_current_values->fan == 1) {
-            venta_set_fan(3);
-          } else if (humifier_current_values->fan == 3) {
-            venta_set_fan(4);
-          }
-        } else if (scene_data->fan == 3) {     
-          venta_set_fan(3);
-          venta_set_fan(3);
-        }
-      } else {
-        vdc_report(LOG_INFO, "memory allocation for scene data failed!");   
-      }
+  vdc_report(LOG_NOTICE, "called scene: %d for %d devices\n", scene, (int) n_dsuid);
+
+  /* only queue the per device plans here, each device executes its plan on its own command thread */
+  for (size_t i = 0; i < n_dsuid; i++) {
+    venta_vdcd_t *dev = find_device_by_dsuid(dsuid[i]);
+    if (dev == NULL) {
+      vdc_report(LOG_WARNING, "call scene: unhandled dsuid %s\n", dsuid[i]);
+      continue;
+    }
+
+    scene_t* scene_data = get_scene_configuration(dev->humifier, scene);
+    if (scene_data != NULL) {
+      venta_call_scene(dev, scene_data);
     } else {
-      vdc_report(LOG_INFO, "called scene is not configured");  
+      vdc_report(LOG_INFO, "called scene is not configured for %s\n", dev->dsuidstring);
     }
   }
 }
 
-void vdc_setprop_cb(dsvdc_t *handle, const char *dsuid, dsvdc_property_t *property, const dsvdc_property_t *properties, void *userdata) {
-  (void) userdata;
-  int ret;
-  uint8_t code = DSVDC_ERR_NOT_IMPLEMENTED;
-  size_t i;
-  vdc_report(LOG_INFO, "set property request for dsuid \"%s\"\n", dsuid);
+static int clamp_channel(double value, int min, int max) {
+  int v = (int) lround(value);
+  return (v < min) ? min : (v > max) ? max : v;
+}
 
-  /*
-   * Properties for the VDC
-   */
-  if (strcasecmp(g_vdc_dsuid, dsuid) == 0) {
-    for (i = 0; i < dsvdc_property_get_num_properties(properties); i++) {
-      char *name;
-      ret = dsvdc_property_get_name(properties, i, &name);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "setprop_cb: error getting property name\n");
-        code = DSVDC_ERR_MISSING_DATA;
-        break;
-      }
-      if (!name) {
-        vdc_report(LOG_ERR, "setprop_cb: not handling wildcard properties\n");
-        code = DSVDC_ERR_NOT_IMPLEMENTED;
-        break;
-      }
+/* send the staged channel values, the command queue keeps only the latest target of a dimming ramp */
+static void apply_channels(venta_vdcd_t *dev) {
+  if (dev->channels_staged & (1u << VENTA_CHANNEL_FAN)) {
+    venta_state_t target = { clamp_channel(dev->channel_values[VENTA_CHANNEL_FAN], VENTA_FAN_MIN, VENTA_FAN_MAX), -1, -1 };
+    if (!venta_command_in_flight(dev, &target)) {
+      venta_change_fan(dev, target.fan);
+    }
+  }
 
-      vdc_report(LOG_INFO, "set request for name=\"%s\"\n", name);
+  dev->channels_staged = 0;
+}
 
-      if (strcmp(name, "zoneID") == 0) {
-        uint64_t zoneID;
-        ret = dsvdc_property_get_uint(properties, i, &zoneID);
-        if (ret != DSVDC_OK) {
-          vdc_report(LOG_ERR, "setprop_cb: error getting property value from property %s\n", name);
-          code = DSVDC_ERR_INVALID_VALUE_TYPE;
-          break;
-        }
-        vdc_report(LOG_NOTICE, "setprop_cb: \"%s\" = %d\n", name, zoneID);
-        g_default_zoneID = zoneID;
-        code = DSVDC_OK;
-      } else {
-        code = DSVDC_ERR_NOT_FOUND;
-        break;
-      }
+/* channel types advertised in channelDescriptions, by channel index */
+static const int32_t channel_types[VENTA_CHANNELS] = {
+  [VENTA_CHANNEL_FAN] = VENTA_CHANNEL_TYPE_FAN
+};
 
-      free(name);
+/* the vdSM addresses a channel by its type, 0 is the default channel */
+static int channel_index(int32_t type) {
+  if (type == 0) {
+    return 0;
+  }
+  for (int c = 0; c < VENTA_CHANNELS; c++) {
+    if (channel_types[c] == type) {
+      return c;
     }
+  }
+  return -1;
+}
 
-    if (code == DSVDC_OK) {
-      write_config();
-    }
+void vdc_output_channel_value_cb(dsvdc_t *handle __attribute__((unused)), char **dsuid, size_t n_dsuid, bool apply_now, int32_t type, double value, int32_t *group, int32_t *zone_id, void *userdata) {
+  vdc_report(LOG_INFO, "set output channel type %d to %.1f for %d devices%s\n", type, value, (int) n_dsuid, apply_now ? "" : ", not applied yet");
 
-    dsvdc_send_set_property_response(handle, property, code);
-    return;
-  } 
-  
-  if (strcasecmp(humifier_device->dsuidstring, dsuid) != 0) {	  
-    vdc_report(LOG_WARNING, "set property: unhandled dsuid %s\n", dsuid);
-    dsvdc_property_free(property);
+  int channel = channel_index(type);
+  if (channel < 0) {
+    vdc_report(LOG_WARNING, "set output channel: unknown channel type %d\n", type);
     return;
   }
 
-  /*
-   * Properties for the VDSD's
-   */
-  pthread_mutex_lock(&g_network_mutex);
-  for (i = 0; i < dsvdc_property_get_num_properties(properties); i++) {
-    char *name;
-
-    int ret = dsvdc_property_get_name(properties, i, &name);
-    if (ret != DSVDC_OK) {
-      vdc_report(LOG_ERR, "getprop_cb: error getting property name, abort\n");
-      dsvdc_send_get_property_response(handle, property);
-      pthread_mutex_unlock(&g_network_mutex);
-      return;
-    }
-    if (!name) {
-      vdc_report(LOG_ERR, "getprop_cb: not yet handling wildcard properties\n");
-      //dsvdc_send_property_response(handle, property);
+  for (size_t i = 0; i < n_dsuid; i++) {
+    venta_vdcd_t *dev = find_device_by_dsuid(dsuid[i]);
+    if (dev == NULL) {
+      vdc_report(LOG_WARNING, "set output channel: unhandled dsuid %s\n", dsuid[i]);
       continue;
     }
-    vdc_report(LOG_NOTICE, "get request name!!=\"%s\"\n", name);
 
-    if (strcmp(name, "zoneID") == 0) {
-      uint64_t zoneID;
-      ret = dsvdc_property_get_uint(properties, i, &zoneID);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "setprop_cb: error getting property value from property %s\n", name);
-        code = DSVDC_ERR_INVALID_VALUE_TYPE;
-        break;
-      }
-      vdc_report(LOG_NOTICE, "setprop_cb: \"%s\" = %d\n", name, zoneID);
-      humifier_device->humifier->zoneID = zoneID;
-      code = DSVDC_OK;
-    } else {
-      code = DSVDC_OK;
+    dev->channel_values[channel] = value;
+    dev->channels_staged |= 1u << channel;
+    if (apply_now) {
+      apply_channels(dev);
     }
-      
-
-    free(name);
   }
-  pthread_mutex_unlock(&g_network_mutex);
-
-  dsvdc_send_set_property_response(handle, property, code);
 }
 
-dsvdc_property_t* create_action_property(char *id, char *title, char* description) {
-  dsvdc_property_t *nProp;
-  if (dsvdc_property_new(&nProp) != DSVDC_OK) {
-    vdc_report(LOG_ERR, "failed to allocate reply property");
-    return NULL;
-  }
-               
-  dsvdc_property_add_string (nProp, "id", id);
-  dsvdc_property_add_string (nProp, "action", id);
-  dsvdc_property_add_string (nProp, "title", title);
-  dsvdc_property_add_string (nProp, "description", description);
-  
-  return nProp;
-}
+/*
+ * Live property handlers, indexed by property id. Names without a handler are answered from
+ * the property cache, names known to neither end up in a single warning. Get handlers only
+ * see the snapshot of the device state taken for the query (NULL for the vDC), the reply is
+ * built without holding g_network_mutex.
+ */
 
-void vdc_getprop_cb(dsvdc_t *handle, const char *dsuid, dsvdc_property_t *property, const dsvdc_property_t *query, void *userdata) {
-  (void) userdata;
-  int ret;
-  size_t i;
-  char *name;
-  
-  vdc_report(LOG_INFO, "get property for dsuid: %s\n", dsuid);
+typedef void (*get_handler_t)(const venta_snapshot_t *snap, dsvdc_property_t *property, const char *name, const dsvdc_property_t *query, size_t index);
+typedef uint8_t (*set_handler_t)(venta_vdcd_t *dev, const dsvdc_property_t *properties, size_t index, const char *name);
 
-  /*
-   * Properties for the VDC
-   */
-  if (strcasecmp(g_vdc_dsuid, dsuid) == 0) {
-    for (i = 0; i < dsvdc_property_get_num_properties(query); i++) {
+static uint8_t set_vdc_zone_id(venta_vdcd_t *dev __attribute__((unused)), const dsvdc_property_t *properties, size_t index, const char *name) {
+  uint64_t zoneID;
 
-      int ret = dsvdc_property_get_name(query, i, &name);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "getprop_cb: error getting property name, abort\n");
-        dsvdc_send_get_property_response(handle, property);
-        return;
-      }
-      if (!name) {
-        vdc_report(LOG_ERR, "getprop_cb: not yet handling wildcard properties\n");
-        dsvdc_send_get_property_response(handle, property);
-        return;
-      }
-      vdc_report(LOG_NOTICE, "get request name=\"%s\"\n", name);
+  if (dsvdc_property_get_uint(properties, index, &zoneID) != DSVDC_OK) {
+    vdc_report(LOG_ERR, "setprop_cb: error getting property value from property %s\n", name);
+    return DSVDC_ERR_INVALID_VALUE_TYPE;
+  }
+  vdc_report(LOG_NOTICE, "setprop_cb: \"%s\" = %d\n", name, zoneID);
+  g_default_zoneID = zoneID;
+  return DSVDC_OK;
+}
 
-      if ((strcmp(name, "hardwareGuid") == 0) || (strcmp(name, "displayId") == 0)) {
-        char info[256];
-        char buffer[32];
-        size_t n;
+static uint8_t set_device_zone_id(venta_vdcd_t *dev, const dsvdc_property_t *properties, size_t index, const char *name) {
+  uint64_t zoneID;
 
-        memset(info, 0, sizeof(info));
-        if (strcmp(name, "hardwareGuid") == 0) {
-          strcpy(info, "humifier-id:");
-        }
-        sprintf(buffer, "%d", venta.humifier.id);
-        strcat(info, buffer);
-        dsvdc_property_add_string(property, name, info);
-
-      } else if (strcmp(name, "vendorId") == 0) {
-      } else if (strcmp(name, "oemGuid") == 0) {
-
-      } else if (strcmp(name, "implementationId") == 0) {
-        dsvdc_property_add_string(property, name, "Venta Humifier");
-
-      } else if (strcmp(name, "modelUID") == 0) {
-        dsvdc_property_add_string(property, name, "Venta Humifier");
-
-      } else if (strcmp(name, "modelGuid") == 0) {
-        dsvdc_property_add_string(property, name, "Venta Humifier");
-
-      } else if (strcmp(name, "name") == 0) {
-        char info[256];
-        strcpy(info, "Venta Humifier ");
-        strcat(info, venta.humifier.name);
-        dsvdc_property_add_string(property, name, info);
-
-      } else if (strcmp(name, "model") == 0) {
-        char hostname[HOST_NAME_MAX];
-        gethostname(hostname, HOST_NAME_MAX);
-        char servicename[HOST_NAME_MAX + 32];
-        strcpy(servicename, "Venta Humifier Controller @");
-        strcat(servicename, hostname);
-        dsvdc_property_add_string(property, name, servicename);
-
-      } else if (strcmp(name, "capabilities") == 0) {
-        dsvdc_property_t *reply;
-        ret = dsvdc_property_new(&reply);
-        if (ret != DSVDC_OK) {
-          vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-          free(name);
-          continue;
-        }
-        dsvdc_property_add_bool(reply, "metering", false);
-        dsvdc_property_add_bool(reply, "dynamicDefinitions", true);
-        dsvdc_property_add_property(property, name, &reply);
-
-      } else if (strcmp(name, "configURL") == 0) {
+  if (dsvdc_property_get_uint(properties, index, &zoneID) != DSVDC_OK) {
+    vdc_report(LOG_ERR, "setprop_cb: error getting property value from property %s\n", name);
+    return DSVDC_ERR_INVALID_VALUE_TYPE;
+  }
+  vdc_report(LOG_NOTICE, "setprop_cb: \"%s\" = %d\n", name, zoneID);
+  dev->humifier->zoneID = zoneID;
+  return DSVDC_OK;
+}
 
+static void get_vdc_zone_id(const venta_snapshot_t *snap __attribute__((unused)), dsvdc_property_t *property, const char *name, const dsvdc_property_t *query __attribute__((unused)), size_t index __attribute__((unused))) {
+  dsvdc_property_add_uint(property, name, g_default_zoneID);
+}
 
-      } else if (strcmp(name, "zoneID") == 0) {
-        dsvdc_property_add_uint(property, "zoneID", g_default_zoneID);
+static void get_device_zone_id(const venta_snapshot_t *snap, dsvdc_property_t *property, const char *name, const dsvdc_property_t *query __attribute__((unused)), size_t index __attribute__((unused))) {
+  dsvdc_property_add_uint(property, name, snap->zoneID);
+}
 
-      /* user properties: user name, client_id, status */
+static void get_channel_states(const venta_snapshot_t *snap, dsvdc_property_t *property, const char *name, const dsvdc_property_t *query __attribute__((unused)), size_t index __attribute__((unused))) {
+  dsvdc_property_t *reply;
+  if (dsvdc_property_new(&reply) != DSVDC_OK) {
+    vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
+    return;
+  }
 
-      }
-      free(name);
+  char channelIndex[16];
+  for (int c = 0; c < VENTA_CHANNELS; c++) {
+    dsvdc_property_t *nProp;
+    if (dsvdc_property_new(&nProp) != DSVDC_OK) {
+      break;
     }
+    dsvdc_property_add_double(nProp, "value", snap->channel_values[c]);
+    snprintf(channelIndex, sizeof(channelIndex), "%d", c);
+    dsvdc_property_add_property(reply, channelIndex, &nProp);
+  }
 
-    dsvdc_send_get_property_response(handle, property);
-    return;
-  } 
+  dsvdc_property_add_property(property, name, &reply);
+}
 
-  if (strcasecmp(humifier_device->dsuidstring, dsuid) != 0) {	  
-    vdc_report(LOG_WARNING, "get property: unhandled dsuid %s\n", dsuid);
-    dsvdc_property_free(property);
+/* query is NULL for a wildcard request, otherwise index is the sensorStates element of query */
+static void get_sensor_states(const venta_snapshot_t *snap, dsvdc_property_t *property, const char *name, const dsvdc_property_t *query, size_t index) {
+  dsvdc_property_t *reply;
+  if (dsvdc_property_new(&reply) != DSVDC_OK) {
+    vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
     return;
   }
 
-  /*
-   * Properties for the VDSD's
-   */
-  pthread_mutex_lock(&g_network_mutex);
-  for (i = 0; i < dsvdc_property_get_num_properties(query); i++) {
-
-    int ret = dsvdc_property_get_name(query, i, &name);
-    if (ret != DSVDC_OK) {
-      vdc_report(LOG_ERR, "getprop_cb: error getting property name, abort\n");
-      dsvdc_send_get_property_response(handle, property);
-      pthread_mutex_unlock(&g_network_mutex);
-      return;
+  int idx = -1;
+  char* sensorIndex;
+  dsvdc_property_t *sensorRequest;
+  if (query != NULL && dsvdc_property_get_property_by_index(query, index, &sensorRequest) == DSVDC_OK) {
+    if (dsvdc_property_get_name(sensorRequest, 0, &sensorIndex) == DSVDC_OK && sensorIndex != NULL) {
+      idx = strtol(sensorIndex, NULL, 10);
+      free(sensorIndex);
     }
-    if (!name) {
-      vdc_report(LOG_ERR, "getprop_cb: not yet handling wildcard properties\n");
-      //dsvdc_send_property_response(handle, property);
+    dsvdc_property_free(sensorRequest);
+  }
+  if (idx < 0) {
+    vdc_report(LOG_DEBUG, "sensorStates: no index in request\n");
+  }
+
+  vdc_time_t now = vdc_clock_ms();
+  bool valid = true;
+  int n_values = 0;
+  
+  for (int i = 0; i < snap->n_sensors; i++) {
+    if (idx >= 0 && idx != i) {
       continue;
     }
-    vdc_report(LOG_NOTICE, "get request name=\"%s\"\n", name);
 
-    if (strcmp(name, "primaryGroup") == 0) {
-      dsvdc_property_add_uint(property, "primaryGroup", 8);
-    } else if (strcmp(name, "zoneID") == 0) {
-      dsvdc_property_add_uint(property, "zoneID", humifier_device->humifier->zoneID);
-    } else if (strcmp(name, "buttonInputDescriptions") == 0) {
-     
-
-    } else if (strcmp(name, "buttonInputSettings") == 0) {
-      
-    } else if (strcmp(name, "dynamicActionDescriptions") == 0) { 
-      dsvdc_property_t *reply;
-      ret = dsvdc_property_new(&reply);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-        free(name);
-        continue;
-      }
+    dsvdc_property_t *nProp;
+    if (dsvdc_property_new(&nProp) != DSVDC_OK) {
+      vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
+      break;
+    }
 
-      int i = 0;
-      char propIndex[64];     
-      dsvdc_property_t *nProp;
-
-      nProp = create_action_property("dynamic.ActTurnOn", "01-Einschalten", "01-Einschalten");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActTurnOn", &nProp);
-      
-      nProp = create_action_property("dynamic.ActTurnOff", "02-Ausschalten", "02-Ausschalten");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActTurnOff", &nProp);
-      
-      nProp = create_action_property("dynamic.ActFan1", "03-Fanspeed 1", "03-Fanspeed 1");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActFan1", &nProp);
-      
-      nProp = create_action_property("dynamic.ActFan2", "04-Fanspeed 2", "04-Fanspeed 2");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActFan2", &nProp);
-      
-      nProp = create_action_property("dynamic.ActFan3", "05-Fanspeed 3", "05-Fanspeed 3");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActFan3", &nProp);
-      
-      nProp = create_action_property("dynamic.ActSleepModeOn", "06-Schlafmodus an", "06-Schlafmodus an");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActSleepModeOn", &nProp);
-      
-      nProp = create_action_property("dynamic.ActSleepmodeOff", "07-Schlafmodus aus", "07-Schlafmodus aus");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActSleepModeOff", &nProp);
-      
-      nProp = create_action_property("dynamic.ActAutoModeOn", "08-Automatikmodus an", "08-Automatikmodus an");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActAutoModeOn", &nProp);
-      
-      nProp = create_action_property("dynamic.ActAutoModeOff", "09-Automatikmodus aus", "09-Automatikmodus aus");          
-      //snprintf(propIndex, 64, "%d", i++);
-      dsvdc_property_add_property(reply, "ActAutoModeOff", &nProp);
-      
-
-      dsvdc_property_add_property(property, name, &reply); 
-
-    } else if (strcmp(name, "outputDescription") == 0) {
-      dsvdc_property_t *reply;
-      ret  = dsvdc_property_new(&reply);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-        free(name);
-        continue;
-      }
-      
-      dsvdc_property_add_string(reply, "name", "Venta Humifier");
-      dsvdc_property_add_uint(reply, "defaultGroup", 8);
-      dsvdc_property_add_uint(reply, "function", 0);
-      dsvdc_property_add_uint(reply, "outputUsage", 1);
-      dsvdc_property_add_bool(reply, "variableRamp", true);
-      dsvdc_property_add_uint(reply, "maxPower", 100);
-
-      dsvdc_property_add_property(property, name, &reply);       
-
-    } else if (strcmp(name, "outputSettings") == 0) {
-      dsvdc_property_t *reply;
-      dsvdc_property_t *groups;
-      ret  = dsvdc_property_new(&reply);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-        free(name);
-        continue;
-      }
-      ret  = dsvdc_property_new(&groups);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "failed to allocate groups property for %s\n", name);
-        free(name);
-        continue;
-      }
+    if (snap->sensors[i].last_query == 0) {
+      valid = false;
+    }
 
-      dsvdc_property_add_bool(groups, "0", true);
-      dsvdc_property_add_bool(groups, "3", true);
-      dsvdc_property_add_property(reply, "groups", &groups);
-      dsvdc_property_add_uint(reply, "mode", 1);
-      dsvdc_property_add_bool(reply, "pushChanges", true);
-
-      dsvdc_property_add_property(property, name, &reply);
-
-    } else if (strcmp(name, "channelDescriptions") == 0) {
-    } else if (strcmp(name, "channelSettings") == 0) {
-    } else if (strcmp(name, "channelStates") == 0) {
-    } else if (strcmp(name, "deviceStates") == 0) {
-      
-    } else if (strcmp(name, "deviceProperties") == 0) {
-      
-    } else if (strcmp(name, "devicePropertyDescriptions") == 0) {
-    
-    } else if (strcmp(name, "customActions") == 0) {
-
-    } else if (strcmp(name, "binaryInputDescriptions") == 0) {      
-        
-    } else if (strcmp(name, "binaryInputSettings") == 0) {      
-      
-    } else if (strcmp(name, "sensorDescriptions") == 0) {
-      dsvdc_property_t *reply;
-      ret = dsvdc_property_new(&reply);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-        free(name);
-        continue;
-      }
+    dsvdc_property_add_double(nProp, "value", snap->sensors[i].value);
+    dsvdc_property_add_double(nProp, "age", (now - snap->sensors[i].last_query) / 1000.0);
+    dsvdc_property_add_int(nProp, "error", 0);
 
-      int i = 0;
-      char sensorName[64];
-      char sensorIndex[64];
-	    
-      while(1) {
-        if (humifier_device->humifier->sensor_values[i].is_active) {
-          vdc_report(LOG_ERR, "************* %d %s\n", i, humifier_device->humifier->sensor_values[i].value_name);
-        
-          snprintf(sensorName, 64, "%s-%s", humifier_device->humifier->name, humifier_device->humifier->sensor_values[i].value_name);
-
-          dsvdc_property_t *nProp;
-          if (dsvdc_property_new(&nProp) != DSVDC_OK) {
-            vdc_report(LOG_ERR, "failed to allocate reply property for %s/%s\n", name, sensorName);
-            break;
-          }
-          dsvdc_property_add_string(nProp, "name", sensorName);
-          dsvdc_property_add_uint(nProp, "sensorType", humifier_device->humifier->sensor_values[i].sensor_type);
-          dsvdc_property_add_uint(nProp, "sensorUsage", humifier_device->humifier->sensor_values[i].sensor_usage);
-          dsvdc_property_add_double(nProp, "aliveSignInterval", 300);
-
-          snprintf(sensorIndex, 64, "%d", i);
-          dsvdc_property_add_property(reply, sensorIndex, &nProp);
-
-          vdc_report(LOG_INFO, "sensorDescription: dsuid %s sensorIndex %s: %s type %d usage %d\n", dsuid, sensorIndex, sensorName, humifier_device->humifier->sensor_values[i].sensor_type, humifier_device->humifier->sensor_values[i].sensor_usage); 
-          
-          i++;
-        } else {
-          break;
-        }
-      }
+    char replyIndex[64];
+    snprintf(replyIndex, 64, "%d", i);
+    dsvdc_property_add_property(reply, replyIndex, &nProp);
+    n_values++;
+  }
+  dsvdc_property_add_property(property, name, &reply);  
 
-		  dsvdc_property_add_property(property, name, &reply);  
-    } else if (strcmp(name, "sensorSettings") == 0) {
-      dsvdc_property_t *reply;
-      ret = dsvdc_property_new(&reply);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-        free(name);
-        continue;
-      }
+  /* a reply without any sensor value says nothing about readiness */
+  if (valid && n_values > 0 && g_first_valid_reply == 0) {
+    g_first_valid_reply = now;
+    vdc_report(LOG_NOTICE, "startup: first valid sensorStates reply %lld ms after process start\n", (long long) (now - g_process_start));
+  }
+}
 
-      char sensorIndex[64];
-      int i = 0;
-      while (1) {
-        if (humifier_device->humifier->sensor_values[i].is_active) {
-          dsvdc_property_t *nProp;
-          if (dsvdc_property_new(&nProp) != DSVDC_OK) {
-            vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-            break;
-          }
-          dsvdc_property_add_uint(nProp, "group", 8);
-          dsvdc_property_add_uint(nProp, "minPushInterval", 5);
-          dsvdc_property_add_double(nProp, "changesOnlyInterval", 5);
-
-          snprintf(sensorIndex, 64, "%d", i);
-          dsvdc_property_add_property(reply, sensorIndex, &nProp);
-          
-          i++;
-        } else {
-          break;
-        }
-      }
-      dsvdc_property_add_property(property, name, &reply); 
-      
-      vdc_report(LOG_INFO, "sensorSettings: dsuid %s sensorIndex %s\n", dsuid, sensorIndex); 
+static const get_handler_t vdc_get_handlers[VENTA_PROP_COUNT] = {
+  [VENTA_PROP_zoneID] = get_vdc_zone_id
+};
 
-    } else if (strcmp(name, "sensorStates") == 0) {
-      dsvdc_property_t *reply;
-      ret = dsvdc_property_new(&reply);
-      if (ret != DSVDC_OK) {
-        vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-        free(name);
-        continue;
-      }
+static const set_handler_t vdc_set_handlers[VENTA_PROP_COUNT] = {
+  [VENTA_PROP_zoneID] = set_vdc_zone_id
+};
 
-      int idx;
-      char* sensorIndex;
-      dsvdc_property_t *sensorRequest;
-      dsvdc_property_get_property_by_index(query, 0, &sensorRequest);
-      if (dsvdc_property_get_name(sensorRequest, 0, &sensorIndex) != DSVDC_OK) {
-        vdc_report(LOG_DEBUG, "sensorStates: no index in request\n");
-        idx = -1;
-      } else {
-        idx = strtol(sensorIndex, NULL, 10);
-      }
-      dsvdc_property_free(sensorRequest);
-
-      time_t now = time(NULL);
-      
-      int i = 0;
-      while (1) {
-        if (humifier_device->humifier->sensor_values[i].is_active) {
-          if (idx >= 0 && idx != i) {
-            i++;
-            continue;
-          }
-
-          dsvdc_property_t *nProp;
-          if (dsvdc_property_new(&nProp) != DSVDC_OK) {
-            vdc_report(LOG_ERR, "failed to allocate reply property for %s\n", name);
-            break;
-          }
-
-          double val = humifier_device->humifier->sensor_values[i].value;
-
-          dsvdc_property_add_double(nProp, "value", val);
-          dsvdc_property_add_int(nProp, "age", now - humifier_device->humifier->sensor_values[i].last_query);
-          dsvdc_property_add_int(nProp, "error", 0);
-
-          char replyIndex[64];
-          snprintf(replyIndex, 64, "%d", i);
-          dsvdc_property_add_property(reply, replyIndex, &nProp);
-          
-          i++;
-        } else {
-          break;
-        }
-      }
-      dsvdc_property_add_property(property, name, &reply);  
+static const get_handler_t device_get_handlers[VENTA_PROP_COUNT] = {
+  [VENTA_PROP_zoneID] = get_device_zone_id,
+  [VENTA_PROP_channelStates] = get_channel_states,
+  [VENTA_PROP_sensorStates] = get_sensor_states
+};
 
-    } else if (strcmp(name, "binaryInputStates") == 0) {      
+static const set_handler_t device_set_handlers[VENTA_PROP_COUNT] = {
+  [VENTA_PROP_zoneID] = set_device_zone_id
+};
 
-    } else if (strcmp(name, "name") == 0) {
-      dsvdc_property_add_string(property, name, humifier_device->humifier->name);
+/*
+ * Apply a set property request through the handler table, dev is NULL for the vDC. Names
+ * without a handler yield unhandled_code. Returns the DSVDC_* code of the response.
+ */
+static uint8_t set_properties(venta_vdcd_t *dev, const set_handler_t *handlers, const dsvdc_property_t *properties, uint8_t unhandled_code) {
+  uint8_t code = DSVDC_ERR_NOT_IMPLEMENTED;
+  size_t i;
 
-    } else if (strcmp(name, "type") == 0) {
-      dsvdc_property_add_string(property, name, "vDSD");
+  for (i = 0; i < dsvdc_property_get_num_properties(properties); i++) {
+    char *name;
+    if (dsvdc_property_get_name(properties, i, &name) != DSVDC_OK) {
+      vdc_report(LOG_ERR, "setprop_cb: error getting property name\n");
+      return DSVDC_ERR_MISSING_DATA;
+    }
+    if (!name) {
+      vdc_report(LOG_ERR, "setprop_cb: not handling wildcard properties\n");
+      return DSVDC_ERR_NOT_IMPLEMENTED;
+    }
+    vdc_report(LOG_INFO, "set request for name=\"%s\"\n", name);
 
-    } else if (strcmp(name, "model") == 0) {
-      char info[256];
-      strcpy(info, "Humifier");
-     
-      dsvdc_property_add_string(property, name, info);
-    } else if (strcmp(name, "modelFeatures") == 0) {
-      dsvdc_property_t *nProp;
-      dsvdc_property_new(&nProp);
-      dsvdc_property_add_bool(nProp, "dontcare", false);
-      dsvdc_property_add_bool(nProp, "blink", false);
-      dsvdc_property_add_bool(nProp, "outmode", false);
-      dsvdc_property_add_bool(nProp, "jokerconfig", true);
-      dsvdc_property_add_property(property, name, &nProp);
-    } else if (strcmp(name, "modelUID") == 0) {      
-      dsvdc_property_add_string(property, name, "Venta Humifier");
+    venta_property_t id = venta_property_lookup(name);
+    if (id == VENTA_PROP_UNKNOWN || handlers[id] == NULL) {
+      vdc_report(LOG_WARNING, "set property handler: unhandled name=\"%s\"\n", name);
+      code = unhandled_code;
+    } else {
+      code = handlers[id](dev, properties, i, name);
+    }
+    free(name);
 
-    } else if (strcmp(name, "modelVersion") == 0) {
-      dsvdc_property_add_string(property, name, "0");
+    if (code != DSVDC_OK) {
+      break;
+    }
+  }
+  return code;
+}
 
-    } else if (strcmp(name, "deviceClass") == 0) {
-    } else if (strcmp(name, "deviceClassVersion") == 0) {
-    } else if (strcmp(name, "oemGuid") == 0) {
-    } else if (strcmp(name, "oemModelGuid") == 0) {
+void vdc_setprop_cb(dsvdc_t *handle, const char *dsuid, dsvdc_property_t *property, const dsvdc_property_t *properties, void *userdata) {
+  (void) userdata;
+  uint8_t code;
 
-    } else if (strcmp(name, "vendorId") == 0) {
-      dsvdc_property_add_string(property, name, "vendor: Venta");
+  vdc_report(LOG_INFO, "set property request for dsuid \"%s\"\n", dsuid);
 
-    } else if (strcmp(name, "vendorName") == 0) {
-      dsvdc_property_add_string(property, name, "Venta");
+  /*
+   * Properties for the VDC
+   */
+  venta_vdcd_t *dev;
+  venta_target_t target = venta_registry_lookup(dsuid, &dev);
 
-    } else if (strcmp(name, "vendorGuid") == 0) {
-      char info[256];
-      strcpy(info, "Venta vDC ");
-      strcat(info, humifier_device->humifier->id);
-      dsvdc_property_add_string(property, name, info);
+  if (target == VENTA_TARGET_VDC) {
+    code = set_properties(NULL, vdc_set_handlers, properties, DSVDC_ERR_NOT_FOUND);
+    if (code == DSVDC_OK) {
+      venta_config_changed();
+    }
 
-    } else if (strcmp(name, "hardwareVersion") == 0) {
-      dsvdc_property_add_string(property, name, "0.0.0");
+    dsvdc_send_set_property_response(handle, property, code);
+    return;
+  } 
+  
+  if (target != VENTA_TARGET_DEVICE) {
+    vdc_report(LOG_WARNING, "set property: unhandled dsuid %s\n", dsuid);
+    dsvdc_property_free(property);
+    return;
+  }
 
-    } else if (strcmp(name, "configURL") == 0) {
-      dsvdc_property_add_string(property, name, "");
+  /*
+   * Properties for the VDSD's
+   */
+  pthread_mutex_lock(&g_network_mutex);
+  code = set_properties(dev, device_set_handlers, properties, DSVDC_OK);
+  pthread_mutex_unlock(&g_network_mutex);
 
-    } else if (strcmp(name, "hardwareModelGuid") == 0) {
-      dsvdc_property_add_string(property, name, "");
+  dsvdc_send_set_property_response(handle, property, code);
+}
 
-    } else if (strcmp(name, "deviceIcon16") == 0) {
-        dsvdc_property_add_bytes(property, name, gVentaHumifier16Data, gVentaHumifier16Size);
+/*
+ * Answer a property query through the handler table of the level, dev is NULL for the vDC.
+ * A wildcard element (no name or "*") is answered with every property of the level in the
+ * same pass. Returns false if the query could not be read.
+ */
+static bool get_properties(venta_vdcd_t *dev, const venta_snapshot_t *snap, const get_handler_t *handlers, dsvdc_property_t *property, const dsvdc_property_t *query) {
+  size_t i;
+  char *name;
 
-    } else if (strcmp(name, "deviceIcon48") == 0) {
-        dsvdc_property_add_bytes(property, name, gVentaHumifier48Data, gVentaHumifier48Size);
+  for (i = 0; i < dsvdc_property_get_num_properties(query); i++) {
 
-    } else if (strcmp(name, "deviceIconName") == 0) {
-      char info[256];
-      strcpy(info, "venta-humifier-16.png");
-      
-      dsvdc_property_add_string(property, name, info);
+    if (dsvdc_property_get_name(query, i, &name) != DSVDC_OK) {
+      vdc_report(LOG_ERR, "getprop_cb: error getting property name, abort\n");
+      return false;
+    }
 
-    } else {
+    if (name == NULL || strcmp(name, "*") == 0) {
+      vdc_report(LOG_NOTICE, "get request for all properties\n");
+      for (int p = 0; p < VENTA_PROP_COUNT; p++) {
+        if (handlers[p] != NULL) {
+          handlers[p](snap, property, venta_property_name(p), NULL, 0);
+        } else if (dev != NULL) {
+          venta_properties_add(dev, property, p);
+        } else {
+          venta_properties_add_vdc(property, p);
+        }
+      }
+      free(name);
+      continue;
+    }
+    vdc_report(LOG_NOTICE, "get request name=\"%s\"\n", name);
+
+    venta_property_t id = venta_property_lookup(name);
+    if (id != VENTA_PROP_UNKNOWN && handlers[id] != NULL) {
+      handlers[id](snap, property, name, query, i);
+    } else if (id == VENTA_PROP_UNKNOWN ||
+        !(dev != NULL ? venta_properties_add(dev, property, id) : venta_properties_add_vdc(property, id))) {
       vdc_report(LOG_WARNING, "get property handler: unhandled name=\"%s\"\n", name);
     }
 
     free(name);
   }
+  return true;
+}
 
+/* copy the live state of a device, the only part of a query that needs g_network_mutex */
+static void take_snapshot(venta_vdcd_t *dev, venta_snapshot_t *snap) {
+  pthread_mutex_lock(&g_network_mutex);
+  snap->zoneID = dev->humifier->zoneID;
+  snap->channel_values[VENTA_CHANNEL_FAN] = dev->current_values.fan;
+  snap->n_sensors = dev->n_sensors;
+  for (int i = 0; i < dev->n_sensors; i++) {
+    snap->sensors[i].value = dev->sensors[i].value;
+    snap->sensors[i].last_query = dev->sensors[i].last_query;
+  }
   pthread_mutex_unlock(&g_network_mutex);
+}
+
+/* reply to a vDSD property query, live state comes from a snapshot, static answers from the cache */
+void venta_get_device_properties(venta_vdcd_t *dev, dsvdc_property_t *property, const dsvdc_property_t *query) {
+  venta_snapshot_t snap;
+
+  take_snapshot(dev, &snap);
+  get_properties(dev, &snap, device_get_handlers, property, query);
+}
+
+void vdc_getprop_cb(dsvdc_t *handle, const char *dsuid, dsvdc_property_t *property, const dsvdc_property_t *query, void *userdata) {
+  (void) userdata;
+
+  vdc_report(LOG_INFO, "get property for dsuid: %s\n", dsuid);
+
+  /*
+   * Properties for the VDC
+   */
+  venta_vdcd_t *dev;
+  venta_target_t target = venta_registry_lookup(dsuid, &dev);
+
+  if (target == VENTA_TARGET_VDC) {
+    get_properties(NULL, NULL, vdc_get_handlers, property, query);
+    dsvdc_send_get_property_response(handle, property);
+    return;
+  } 
+
+  if (target != VENTA_TARGET_DEVICE) {
+    vdc_report(LOG_WARNING, "get property: unhandled dsuid %s\n", dsuid);
+    dsvdc_property_free(property);
+    return;
+  }
+
+  /*
+   * Properties for the VDSD's
+   */
+  venta_get_device_properties(dev, property, query);
   dsvdc_send_get_property_response(handle, property);
 }
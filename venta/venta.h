@@ -9,13 +9,50 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <syslog.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 
 #include <digitalSTROM/dsuid.h>
 #include <dsvdc/dsvdc.h>
 
+typedef int64_t vdc_time_t;       /* monotonic clock in milliseconds, see vdc_clock_ms() */
+
 #define MAX_SENSOR_VALUES 15
 #define MAX_BINARY_VALUES 15
 #define MAX_SCENES 128
+#define DS_SCENES 128              /* digitalSTROM scene number space */
+#define VENTA_CACHE_LINE 64
+
+#define VENTA_FAN_MIN 1
+#define VENTA_FAN_MAX 3
+#define VENTA_BUTTONS 4
+#define VENTA_MAX_PRESSES 8
+#define VENTA_CONFIRM_DELAY 2000     /* ms from a command to the poll confirming its optimistic state */
+#define VENTA_MAX_RETRIES 2          /* re-planned attempts after a failed verification */
+#define VENTA_SETTLE_DEADLINE 30000  /* ms a command may take to settle, including retries */
+#define VENTA_COMMAND_WORKERS 16     /* threads executing the commands of all devices */
+
+/*
+ * dS output channels by index in channelDescriptions and channelStates. The vDC API reserves
+ * channel types 192..239 for device specific channels. The fan level is one of them, because
+ * the standard air flow intensity (12) is a 0..100 % value and not one of three levels.
+ */
+#define VENTA_CHANNELS 1
+#define VENTA_CHANNEL_FAN 0          /* fan level VENTA_FAN_MIN..VENTA_FAN_MAX */
+#define VENTA_CHANNEL_TYPE_FAN 192
+#define VENTA_MIN_PUSH_INTERVAL 5     /* default sensor settings in seconds */
+#define VENTA_ALIVE_SIGN_INTERVAL 300
+#define VENTA_CONFIG_WRITE_DELAY 5000 /* ms without further changes before the configuration is written */
+#define VENTA_OUTBOX_BACKOFF 500        /* ms before the first retry of a failed push */
+#define VENTA_OUTBOX_BACKOFF_MAX 16000
+
+/* device state changeable by button presses, -1 in a target state means "don't care" */
+typedef struct venta_state {
+  int8_t fan;
+  int8_t mode_sleep;
+  int8_t mode_automatic;
+} venta_state_t;
 
 typedef struct scene {
   int dsId;
@@ -25,44 +62,197 @@ typedef struct scene {
   int fan;
   int mode_automatic;
   int mode_sleep;
+  venta_state_t target;
 } scene_t;
 
-typedef struct sensor_value {
-  bool is_active;
+/*
+ * Sensor configuration and push parameters. Devices configured with the same sensor_values
+ * group share one table, so the push scan over a fleet reads the same few cache lines.
+ */
+typedef struct sensor_config {
   char *value_name;
   int sensor_type;
   int sensor_usage;
+  double deadband;                      /* minimum change of the value for a push */
+  vdc_time_t min_push_interval;         /* ms */
+  vdc_time_t alive_sign_interval;       /* ms, a value is pushed again before dSS considers the sensor dead */
+} sensor_config_t;
+
+/* sensor state walked by every poll and push scan */
+typedef struct sensor_value {
   double value;
   double last_value;
-  time_t last_query;
-  time_t last_reported;
+  double last_pushed;
+  vdc_time_t last_query;
+  vdc_time_t last_reported;
 } sensor_value_t;
 
+typedef enum {
+  VENTA_PUSH_SCHEDULED,                 /* changes outside the deadband within their rate limit, alive signs */
+  VENTA_PUSH_CHANGED,                   /* changes outside the deadband, ignoring the rate limit */
+  VENTA_PUSH_ALL                        /* all known values, e.g. for a new session */
+} venta_push_mode_t;
+
+/* property names of the vDC and the vDSDs, mapped to a venta_property_t by venta_property_lookup() */
+#define VENTA_PROPERTY_NAMES(X) \
+  X(primaryGroup) X(zoneID) X(name) X(type) X(model) X(modelFeatures) X(modelUID) \
+  X(modelVersion) X(modelGuid) X(deviceClass) X(deviceClassVersion) X(oemGuid) X(oemModelGuid) \
+  X(vendorId) X(vendorName) X(vendorGuid) X(hardwareVersion) X(hardwareGuid) X(hardwareModelGuid) \
+  X(displayId) X(implementationId) X(capabilities) X(configURL) X(deviceIcon16) X(deviceIcon48) \
+  X(deviceIconName) X(buttonInputDescriptions) X(buttonInputSettings) X(binaryInputDescriptions) \
+  X(binaryInputSettings) X(binaryInputStates) X(dynamicActionDescriptions) X(customActions) \
+  X(outputDescription) X(outputSettings) X(channelDescriptions) X(channelSettings) X(channelStates) \
+  X(sensorDescriptions) X(sensorSettings) X(sensorStates) X(deviceStates) X(deviceProperties) \
+  X(devicePropertyDescriptions)
+
+#define VENTA_PROPERTY_ENUM(n) VENTA_PROP_##n,
+
+typedef enum {
+  VENTA_PROPERTY_NAMES(VENTA_PROPERTY_ENUM)
+  VENTA_PROP_COUNT,
+  VENTA_PROP_UNKNOWN = VENTA_PROP_COUNT
+} venta_property_t;
+
+/* device configuration, see venta_vdcd_t for the state */
 typedef struct venta_humifier {
-  dsuid_t dsuid;
   char *id;
   char *name;
   char *ip;
-  char *configured_scenes;
-  sensor_value_t sensor_values[MAX_SENSOR_VALUES];
-  scene_t scenes[MAX_SCENES];
   uint16_t zoneID;
+  int n_scenes;
+  scene_t *scenes;                              /* n_scenes configured scenes */
+  uint8_t scene_index[DS_SCENES];               /* dS scene number -> position in scenes + 1, 0 if not configured */
 } venta_humifier_t;
 
-typedef struct venta_data {
-  venta_humifier_t humifier;
-} venta_data_t;
+/* verification results of a scene, scene DS_SCENES counts commands not issued by a scene */
+typedef struct venta_scene_stats {
+  int scene;
+  unsigned long calls;
+  unsigned long settled;
+  unsigned long failed;
+  unsigned long superseded;
+  unsigned long retries;
+  vdc_time_t settle_total;
+  vdc_time_t settle_max;
+} venta_scene_stats_t;
+
+/* pending target state per device, see commands.c */
+typedef struct venta_command_queue {
+  pthread_mutex_t mutex;
+  bool scheduled;                       /* waiting for or processed by a worker */
+  struct venta_vdcd *next_ready;        /* run queue of the workers */
+  bool pending;
+  bool retry;                           /* pending target re-plans the running operation */
+  venta_state_t target;
+  int scene;
+  uint32_t generation;
+  bool op_active;                       /* operation started, not yet verified */
+  bool op_verify;                       /* presses done, waiting for the verification poll */
+  venta_state_t op_target;
+  int op_scene;
+  int op_retries;
+  vdc_time_t op_started;
+  venta_scene_stats_t *stats;           /* scenes called so far, sorted by scene */
+  int n_stats;
+  unsigned long submitted;
+  unsigned long coalesced;
+  unsigned long presses;
+  unsigned long presses_saved;
+  unsigned long confirmed;
+  unsigned long rolled_back;
+  bool busy;
+} venta_command_queue_t;
+
+/* sensor updates waiting for the session, one slot per sensor, see outbox.c */
+typedef struct venta_outbox {
+  uint32_t pending;
+  double value[MAX_SENSOR_VALUES];            /* latest queued value */
+  vdc_time_t queued[MAX_SENSOR_VALUES];       /* time the oldest unsent update was queued */
+  vdc_time_t retry_at;
+  vdc_time_t backoff;
+  int depth_max;
+  vdc_time_t delay_max;
+  unsigned long enqueued;
+  unsigned long coalesced;                    /* unsent updates replaced by a newer value */
+  unsigned long sent;
+  unsigned long failed;                       /* failed push attempts */
+  unsigned long dropped;                      /* updates discarded, e.g. at the end of a session */
+} venta_outbox_t;
+
+/* what a dSUID of a callback refers to, see registry.c */
+typedef enum {
+  VENTA_TARGET_NONE,
+  VENTA_TARGET_VDC,
+  VENTA_TARGET_LIB,
+  VENTA_TARGET_DEVICE
+} venta_target_t;
 
+/* session bring-up of a device, advanced by the announcement callbacks, see vdsd.c */
+typedef enum {
+  VENTA_BRINGUP_IDLE,                   /* no session or the announcement failed */
+  VENTA_BRINGUP_ANNOUNCING,             /* announcement sent, waiting for the vdSM */
+  VENTA_BRINGUP_ACTIVE                  /* announced and identified, initial values queued */
+} venta_bringup_t;
+
+/* live device state for property replies, copied under g_network_mutex */
+typedef struct venta_snapshot {
+  uint16_t zoneID;
+  double channel_values[VENTA_CHANNELS];
+  int n_sensors;
+  struct {
+    double value;
+    vdc_time_t last_query;
+  } sensors[MAX_SENSOR_VALUES];
+} venta_snapshot_t;
+
+/*
+ * The first cache line holds what the poll and push scans over all devices read, the
+ * sensor states follow in their own cache line aligned array and the push parameters in
+ * the shared sensor configuration. Everything else is touched only when a device is
+ * polled, commanded or queried. Allocated cache line aligned.
+ */
 typedef struct venta_vdcd {
   struct venta_vdcd* next;
+  vdc_time_t next_poll;                 /* deadline of the next regular poll */
+  vdc_time_t confirm_poll;              /* pending confirmation poll after a command, 0 if none, g_wakeup_mutex */
+  sensor_value_t *sensors;              /* n_sensors configured sensors */
+  sensor_config_t *sensor_config;       /* n_sensors entries, shared, see read_sensor_values() */
+  uint8_t n_sensors;
+  bool refresh_requested;               /* poll at once and push all values, g_wakeup_mutex */
+  bool present;
+  bool presentSignaled;
+  bool announced;
+  venta_bringup_t bringup;
+  venta_outbox_t outbox;                /* pending mask first, shares the cache line */
+
   dsuid_t dsuid;
   char dsuidstring[36];
-  bool announced;
-  bool presentSignaled;
-  bool present;
+  vdc_time_t announce_sent;
   venta_humifier_t* humifier;
+  scene_t current_values;               /* device state of the last poll */
+  bool tentative;                       /* current_values hold the expected result of a command, not yet confirmed by a poll */
+  venta_state_t tentative_state;
+  vdc_time_t tentative_since;
+  void *io_data;                        /* private data of the device I/O implementation */
+  venta_command_queue_t commands;
+  double channel_values[VENTA_CHANNELS];  /* channel values staged until applied */
+  uint32_t channels_staged;
+  struct venta_property_cache *properties;  /* static getprop answers, see properties.c */
 } venta_vdcd_t;
 
+struct memory_struct {
+  char *memory;
+  size_t size;
+};
+
+struct venta_vdcd;
+
+/* device I/O: a request to a Venta API path ("/api/data", "/api/btn") with an optional JSON body */
+typedef struct venta_io {
+  const char *name;
+  struct memory_struct* (*request)(struct venta_vdcd *dev, const char *path, const char *body);
+} venta_io_t;
+
 #define VENTA_OK 0
 #define VENTA_OUT_OF_MEMORY -1
 #define VENTA_BAD_CONFIG -12
@@ -72,15 +262,19 @@ typedef struct venta_vdcd {
 
 extern const char *g_cfgfile;
 extern int g_shutdown_flag;
-extern venta_data_t venta;
-extern venta_vdcd_t* humifier_device;
+extern venta_vdcd_t* humifier_device;         /* all configured devices */
 extern pthread_mutex_t g_network_mutex;
-extern scene_t* humifier_current_values;
+extern const venta_io_t *g_venta_io;
 
 extern char g_vdc_modeluid[33];
 extern char g_vdc_dsuid[35];
 extern char g_lib_dsuid[35];
 
+extern vdc_time_t g_process_start;
+extern vdc_time_t g_first_poll_time;
+extern vdc_time_t g_first_valid_reply;
+extern unsigned long g_push_allocations;
+
 extern time_t g_reload_values;
 extern int g_default_zoneID;
 
@@ -88,6 +282,8 @@ extern void vdc_new_session_cb(dsvdc_t *handle __attribute__((unused)), void *us
 extern void vdc_ping_cb(dsvdc_t *handle __attribute__((unused)), const char *dsuid, void *userdata __attribute__((unused)));
 extern void vdc_announce_device_cb(dsvdc_t *handle __attribute__((unused)), int code, void *arg, void *userdata __attribute__((unused)));
 extern void vdc_announce_container_cb(dsvdc_t *handle __attribute__((unused)), int code, void *arg, void *userdata __attribute__((unused)));
+extern void venta_announce_devices(dsvdc_t *handle);
+extern void venta_session_lost();
 extern void vdc_end_session_cb(dsvdc_t *handle __attribute__((unused)), void *userdata);
 extern bool vdc_remove_cb(dsvdc_t *handle __attribute__((unused)), const char *dsuid, void *userdata);
 extern void vdc_blink_cb(dsvdc_t *handle __attribute__((unused)), char **dsuid, size_t n_dsuid, int32_t *group, int32_t *zone_id, void *userdata);
@@ -95,28 +291,93 @@ extern void vdc_getprop_cb(dsvdc_t *handle, const char *dsuid, dsvdc_property_t
 extern void vdc_setprop_cb(dsvdc_t *handle, const char *dsuid, dsvdc_property_t *property, const dsvdc_property_t *properties, void *userdata);
 extern void vdc_callscene_cb(dsvdc_t *handle __attribute__((unused)), char **dsuid, size_t n_dsuid, int32_t scene, bool force, int32_t *group, int32_t *zone_id, void *userdata);
 extern void vdc_savescene_cb(dsvdc_t *handle __attribute__((unused)), char **dsuid, size_t n_dsuid, int32_t scene, int32_t *group, int32_t *zone_id, void *userdata);
+extern void vdc_output_channel_value_cb(dsvdc_t *handle __attribute__((unused)), char **dsuid, size_t n_dsuid, bool apply_now, int32_t type, double value, int32_t *group, int32_t *zone_id, void *userdata);
 extern void vdc_request_generic_cb(dsvdc_t *handle __attribute__((unused)), char *dsuid, char *method_name, dsvdc_property_t *property, const dsvdc_property_t *properties,  void *userdata);
 
-int venta_get_data();
-int venta_set_fan(int btn);
-int venta_set_mode_automatic(bool on);
-int venta_set_mode_sleep(bool on);
-int venta_power_on_off();
-int venta_toggle_automode(scene_t *scene_data);
-int venta_toggle_sleepmod(scene_t *scene_data);
-int venta_change_target_humidity(scene_t *scene_data);
-int venta_change_fan(scene_t *scene_data);
-void push_sensor_data();
-void push_device_states();
-bool is_scene_configured();
-scene_t* get_scene_configuration(int scene);
+void venta_request_refresh(venta_vdcd_t *dev);
+void venta_schedule_poll(venta_vdcd_t *dev, vdc_time_t when);
+vdc_time_t venta_poll_step(vdc_time_t now);
+void* networkThread(void *arg);
+void venta_network_wakeup();
+venta_vdcd_t* find_device_by_dsuid(const char *dsuid);
+int venta_registry_build();
+void venta_registry_free();
+venta_target_t venta_registry_lookup(const char *dsuidstring, venta_vdcd_t **dev);
+int venta_get_data(venta_vdcd_t *dev);
+int venta_press_button(venta_vdcd_t *dev, int btn);
+int venta_apply_state(venta_vdcd_t *dev, const venta_state_t *target);
+int venta_get_cached_state(venta_vdcd_t *dev, venta_state_t *state);
+void venta_set_cached_state(venta_vdcd_t *dev, const venta_state_t *state);
+void venta_commands_init(venta_vdcd_t *dev);
+void venta_commands_destroy(venta_vdcd_t *dev);
+int venta_commands_start();
+void venta_commands_stop();
+void venta_command_submit(venta_vdcd_t *dev, const venta_state_t *target, int scene);
+int venta_call_scene(venta_vdcd_t *dev, const scene_t *scene);
+void venta_commands_report(venta_vdcd_t *dev);
+void venta_commands_process(venta_vdcd_t *dev);
+bool venta_confirm_state(venta_vdcd_t *dev);
+bool venta_commands_idle(venta_vdcd_t *dev);
+bool venta_command_in_flight(venta_vdcd_t *dev, const venta_state_t *target);
+uint8_t venta_invoke_action(venta_vdcd_t *dev, const char *id);
+int venta_plan(const venta_state_t *current, const venta_state_t *target, uint8_t *presses, int max_presses);
+bool venta_state_valid(const venta_state_t *state);
+bool venta_state_matches(const venta_state_t *state, const venta_state_t *target);
+void venta_button_apply(int btn, venta_state_t *state);
+venta_state_t venta_compile_scene(const scene_t *scene);
+int venta_change_fan(venta_vdcd_t *dev, int fan);
+uint32_t venta_sensors_due(venta_vdcd_t *dev, vdc_time_t now, venta_push_mode_t mode, vdc_time_t *next);
+int push_sensor_data(venta_vdcd_t *dev, uint32_t *sensors);
+void venta_outbox_put(venta_vdcd_t *dev, uint32_t sensors);
+int venta_outbox_drain(venta_vdcd_t *dev);
+void venta_outbox_drop(venta_vdcd_t *dev, const char *reason);
+int venta_outbox_depth(venta_vdcd_t *dev);
+void venta_outbox_report(venta_vdcd_t *dev);
+void venta_push_step();
+void venta_push_changed(venta_vdcd_t *dev);
+bool is_scene_configured(venta_humifier_t *humifier, int scene);
+void index_scene(venta_humifier_t *humifier, scene_t *scene);
+scene_t* get_scene_configuration(venta_humifier_t *humifier, int scene);
 int decodeURIComponent (char *sSource, char *sDest);
-sensor_value_t* find_sensor_value_by_name(char *key);
-void save_scene(int scene);
+sensor_value_t* find_sensor_value_by_name(venta_vdcd_t *dev, char *key);
+venta_vdcd_t* venta_device_new(venta_humifier_t *humifier, sensor_config_t *sensor_config, int n_sensors);
+void venta_sensor_config_free();
+void save_scene(venta_vdcd_t *dev, int scene);
+void venta_properties_build(venta_vdcd_t *dev);
+void venta_properties_build_vdc();
+void venta_properties_free(venta_vdcd_t *dev);
+venta_property_t venta_property_lookup(const char *name);
+const char* venta_property_name(venta_property_t id);
+bool venta_properties_add(venta_vdcd_t *dev, dsvdc_property_t *property, venta_property_t id);
+bool venta_properties_add_vdc(dsvdc_property_t *property, venta_property_t id);
+void venta_get_device_properties(venta_vdcd_t *dev, dsvdc_property_t *property, const dsvdc_property_t *query);
+void venta_config_changed();
+void venta_config_flush(bool force);
+
+/* simulation, benchmarks and device farm, only built into vdc-venta-sim */
+#ifdef VENTA_SIMULATION
+extern bool g_simulation;
+int simulation_run(const char *script, vdc_time_t duration);
+int simulation_bench_fanout(int n_devices, int latency_ms);
+int simulation_bench_dimming(int latency_ms);
+int simulation_bench_getprop(int queries);
+int simulation_bench_config(int n_devices);
+
+extern bool g_farm;
+int venta_farm_run(int n_devices, int latency_ms, double failure_percent, vdc_time_t duration);
+void venta_farm_push(venta_vdcd_t *dev, uint32_t sensors);
+int simulation_trace_push(venta_vdcd_t *dev, uint32_t sensors);
+#else
+#define g_simulation false
+#endif
 
 int write_config();
 int read_config();
 
+vdc_time_t vdc_clock_ms(void);
+void vdc_clock_set_virtual(vdc_time_t ms);
+void vdc_clock_timespec(vdc_time_t ms, struct timespec *ts);
+char* vdc_clock_format(vdc_time_t ms, char *buf, size_t len);
 void vdc_init_report();
 void vdc_set_debugLevel(int debug);
 int vdc_get_debugLevel();